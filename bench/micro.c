@@ -0,0 +1,79 @@
+/* micro.c
+ * In-process benchmarks for the shell's parsing hot paths. smallsh.c is included directly
+ * so the real isBlankOrComment, convertToWords and expandCommands are the ones measured.
+ * Prints its results as a JSON object, bench/run.sh adds them to its report.
+*/
+
+#define main smallshMain
+#include "../smallsh.c"
+#undef main
+
+/* nanoseconds()
+ * Takes no inputs
+ * Returns the CLOCK_MONOTONIC time in nanoseconds
+ */
+double nanoseconds(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+int main(int argc, char *argv[]){
+	int iterations = argc > 1 ? atoi(argv[1]) : 20000;
+	shellPidLength = snprintf(shellPid, sizeof(shellPid), "%d", getpid());
+	struct arena arena = {0};
+	volatile int sink = 0;//keeps the compiler from throwing the work away
+
+	//isBlankOrComment on a comment line with leading spaces
+	char comment[] = "        # a comment line that the shell should skip";
+	double start = nanoseconds();
+	for(int i = 0; i < iterations * 50; i++){
+		sink += isBlankOrComment(comment, sizeof(comment) - 1);
+	}
+	double blankNs = (nanoseconds() - start) / (iterations * 50);
+
+	//convertToWords on a line of 512 words, copied back in each time since it is split in place
+	char line[8192];
+	int lineLength = 0;
+	for(int i = 0; i < 512; i++){
+		lineLength += snprintf(line + lineLength, sizeof(line) - lineLength, "arg%03d ", i);
+	}
+	char *work = malloc(lineLength + 1);
+	start = nanoseconds();
+	for(int i = 0; i < iterations; i++){
+		memcpy(work, line, lineLength + 1);
+		char **words;
+		sink += convertToWords(work, lineLength, &arena, &words);
+		arenaReset(&arena);
+	}
+	double tokenizeNs = (nanoseconds() - start) / iterations;
+
+	//expandCommands on words full of $$, at two sizes so any non-linear cost shows up
+	double expandNs[2];
+	int expandCounts[2] = {64, 4096};
+	for(int size = 0; size < 2; size++){
+		int count = expandCounts[size];
+		char *word = malloc(count * 3 + 1);
+		for(int i = 0; i < count; i++){
+			memcpy(word + i * 3, "a$$", 3);
+		}
+		word[count * 3] = '\0';
+		int rounds = iterations * 64 / count + 1;
+		start = nanoseconds();
+		for(int i = 0; i < rounds; i++){
+			char *words[] = {word, NULL};
+			char **w = words;
+			expandCommands(&w, 1, &arena);
+			sink += w[0][0];
+			arenaReset(&arena);
+		}
+		expandNs[size] = (nanoseconds() - start) / rounds / count;
+		free(word);
+	}
+
+	printf("{\"is_blank_or_comment_ns\": %.1f, ",blankNs);
+	printf("\"tokenize_512_words_ns\": %.0f, \"tokenize_mb_per_sec\": %.1f, ",tokenizeNs,lineLength / tokenizeNs * 1000);
+	printf("\"expand_ns_per_pid_small_word\": %.2f, \"expand_ns_per_pid_large_word\": %.2f}\n",expandNs[0],expandNs[1]);
+	free(work);
+	return sink == -1;
+}
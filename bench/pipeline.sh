@@ -0,0 +1,31 @@
+#!/bin/sh
+# pipeline.sh
+# Measures throughput of a multi-stage pipeline run by smallsh, with the default
+# pipe size and with pipes grown through SMALLSH_PIPESZ (F_SETPIPE_SZ).
+# Usage: bench/pipeline.sh [bytes] [number of cat stages] [pipe size in bytes]
+# Run from the top of the repo after building with make.
+
+SHELL_PATH=${SMALLSH:-./smallsh}
+BYTES=${1:-4294967296}
+STAGES=${2:-3}
+PIPE_SIZE=${3:-1048576}
+
+COMMAND="head -c $BYTES /dev/zero"
+i=0
+while [ "$i" -lt "$STAGES" ]; do
+	COMMAND="$COMMAND | cat"
+	i=$((i + 1))
+done
+COMMAND="$COMMAND > /dev/null"
+
+for size in default "$PIPE_SIZE"; do
+	start=$(date +%s%N)
+	if [ "$size" = default ]; then
+		printf '%s\nexit\n' "$COMMAND" | "$SHELL_PATH" > /dev/null
+	else
+		printf '%s\nexit\n' "$COMMAND" | SMALLSH_PIPESZ=$size "$SHELL_PATH" > /dev/null
+	fi
+	end=$(date +%s%N)
+	elapsed=$((end - start))
+	echo "pipe size $size: $BYTES bytes through $((STAGES + 1)) stages in $((elapsed / 1000000)) ms, $((BYTES * 1000 / elapsed)) MB/s"
+done
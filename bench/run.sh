@@ -0,0 +1,65 @@
+#!/bin/sh
+# run.sh
+# Benchmark harness for the shell's hot paths. Drives smallsh non-interactively and
+# prints one JSON object with a number for each stage:
+#   prompts/sec for blank and comment lines (isBlankOrComment and the read loop)
+#   tokenizer throughput and $$ expansion cost (from bench/micro, in process)
+#   fork+exec latency for /bin/true with each launch backend
+#   background job churn (launch and reap)
+# Usage: bench/run.sh [lines] [launches]
+# Run from the top of the repo, "make bench" builds an -O2 shell and runs this.
+
+SHELL_PATH=${SMALLSH:-./smallsh}
+MICRO_PATH=${MICRO:-bench/micro}
+LINES=${1:-200000}
+LAUNCHES=${2:-2000}
+
+INPUT=$(mktemp)
+trap 'rm -f "$INPUT"' EXIT
+
+# repeat LINE COUNT
+# writes LINE to the input file COUNT times, then an exit
+repeat() {
+	awk -v line="$1" -v count="$2" 'BEGIN { for (i = 0; i < count; i++) print line; print "exit" }' > "$INPUT"
+}
+
+# per_second COUNT
+# runs the shell on the input file and prints how many lines per second it got through
+per_second() {
+	start=$(date +%s%N)
+	"$SHELL_PATH" "$INPUT" > /dev/null 2>&1
+	end=$(date +%s%N)
+	echo $(( $1 * 1000000000 / (end - start + 1) ))
+}
+
+# latency_us COUNT [environment]
+# runs the shell on the input file and prints the microseconds per line
+latency_us() {
+	start=$(date +%s%N)
+	env $2 "$SHELL_PATH" "$INPUT" > /dev/null 2>&1
+	end=$(date +%s%N)
+	echo $(( (end - start) / 1000 / $1 ))
+}
+
+repeat "" "$LINES"
+blank=$(per_second "$LINES")
+repeat "   # comment line" "$LINES"
+comment=$(per_second "$LINES")
+
+repeat /bin/true "$LAUNCHES"
+spawn=$(latency_us "$LAUNCHES" SMALLSH_LAUNCH=spawn)
+fork=$(latency_us "$LAUNCHES" SMALLSH_LAUNCH=fork)
+zygote=$(latency_us "$LAUNCHES" SMALLSH_LAUNCH=zygote)
+
+repeat "/bin/true &" "$LAUNCHES"
+churn=$(per_second "$LAUNCHES")
+
+micro=$("$MICRO_PATH" 2>/dev/null || echo null)
+
+printf '{\n'
+printf '  "blank_prompts_per_sec": %s,\n' "$blank"
+printf '  "comment_prompts_per_sec": %s,\n' "$comment"
+printf '  "true_launch_us": {"spawn": %s, "fork": %s, "zygote": %s},\n' "$spawn" "$fork" "$zygote"
+printf '  "background_jobs_per_sec": %s,\n' "$churn"
+printf '  "micro": %s\n' "$micro"
+printf '}\n'
@@ -0,0 +1,29 @@
+#!/bin/sh
+# spawn.sh
+# Compares how many external commands per second smallsh can launch with the
+# posix_spawn backend, the fork backend (SMALLSH_LAUNCH=fork) and the zygote
+# backend (SMALLSH_LAUNCH=zygote).
+# Usage: bench/spawn.sh [number of launches] [command]
+# Run from the top of the repo after building with make.
+
+SHELL_PATH=${SMALLSH:-./smallsh}
+LAUNCHES=${1:-5000}
+COMMAND=${2:-/bin/true}
+
+INPUT=$(mktemp)
+trap 'rm -f "$INPUT"' EXIT
+
+i=0
+while [ "$i" -lt "$LAUNCHES" ]; do
+	echo "$COMMAND"
+	i=$((i + 1))
+done > "$INPUT"
+echo exit >> "$INPUT"
+
+for backend in spawn fork zygote; do
+	start=$(date +%s%N)
+	SMALLSH_LAUNCH=$backend "$SHELL_PATH" < "$INPUT" > /dev/null
+	end=$(date +%s%N)
+	elapsed=$((end - start))
+	echo "$backend: $LAUNCHES launches in $((elapsed / 1000000)) ms, $((LAUNCHES * 1000000000 / elapsed)) launches/sec"
+done
@@ -4,57 +4,516 @@
  * CS344 Assignment 3
 */
 
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE//for pipe2, F_SETPIPE_SZ and W_EXITCODE
 #define DEBUG false //Debug variable to display more detailed outputs if something is not working properly
 
-#define MAX_INPUT_LENGTH 2048//the largest input size allowed from the user
-#define MAX_NUM_ARGUMENTS 512//the most command line arguments allowed from the user
-#define MAX_BACKGROUND_PROCESSES 100//the max number of background processes allowed at one time
+#define ARENA_BLOCK_SIZE 4096//the size of the first block in the per-command arena, bigger commands get extra blocks
+#define INPUT_BLOCK_SIZE 65536//how much input is read at a time, the buffer grows past this for longer lines
+#define COPY_CHUNK_SIZE 1073741824//the most one copy_file_range, splice or sendfile call is asked to move
+#define COPY_BUFFER_SIZE 131072//buffer for copies the kernel can't do itself
+#define LAUNCH_MAX_LIMITS 16//the most resource limits one with prefix can set
+#define IOPRIO_CLASS_SHIFT 13//from linux/ioprio.h, which isn't always installed
+#define IOPRIO_CLASS_RT 1
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+#define ZYGOTE_REQUEST_SIZE 65536//the most bytes of arguments, directory and environment one zygote launch request can carry
+#define ZYGOTE_STACK_SIZE 65536//stack the zygote's children run on between clone and exec
+#define TRACE_RING_SIZE 4096//the most trace records kept in memory before they are written out
+#define REAP_QUEUE_SIZE 256//the most finished children the SIGCHLD handler can hold before the main code looks at them
 
 
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <assert.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <poll.h>
 #include <unistd.h>
 #include <sys/wait.h>
 #include <signal.h>
 #include <fcntl.h>
+#include <spawn.h>
+#include <errno.h>
+#include <time.h>
+#include <termios.h>
+
+extern char **environ;//points at the shell's environment table once it is made, so getenv sees the same variables the shell does
+
+/* enum launchBackend
+ * The ways the shell can start external commands. posix_spawn is the default,
+ * setting SMALLSH_LAUNCH=fork in the environment goes back to the fork and exec path,
+ * and SMALLSH_LAUNCH=zygote hands launches to a small helper process forked at startup
+ */
+enum launchBackend{
+	LAUNCH_SPAWN,
+	LAUNCH_FORK,
+	LAUNCH_ZYGOTE
+};
 
 bool isBackgroundProcess = false;//bool to track if the current process is running in the background
 bool foregroundOnly = false;//bool to track if the shell is running in foreground only mode
 bool modeChanged = false;//keeps track of if the mode has changed since the last time the command line has returned to the user
+bool interactive = false;//true when commands are coming from a terminal, the prompt is only shown then
+bool jobControl = false;//true when the shell owns the terminal and gives it to each foreground job's process group
+int terminalFd = -1;//close on exec copy of the terminal, so children can take it even after their stdin is redirected
+pid_t shellGroup = 0;//the shell's own process group, the terminal goes back to it after every foreground job
+struct termios shellModes;//the terminal settings at the prompt, put back after a job that might have changed them
+volatile sig_atomic_t waitInterrupted = 0;//set by ^C while the wait builtin is waiting
 
 int recentStatus = 0;//Keeps track of the most recent exit status from a command
+char recentLimits[256] = "";//launch options the most recent foreground command was started with, for the status command
+enum launchBackend launchBackend = LAUNCH_SPAWN;//how external commands are started
+pid_t lastBackgroundPid = -1;//pid of the last process in the most recent background job, for $!
+char shellPid[24];//the shell's pid as a string for $$, it never changes so it is only made once
+int shellPidLength = 0;
+char *expansionBuffer = NULL;//where words are built up while they are expanded, reused for every word
+size_t expansionLength = 0;//number of characters in expansionBuffer
+size_t expansionCapacity = 0;//size of expansionBuffer
+int commandFd = -1;//where the shell reads its own commands from, builtins mustn't read from it too
+int pipeBufferSize = 0;//size to grow pipeline pipes to with F_SETPIPE_SZ, set with SMALLSH_PIPESZ. 0 leaves them at the default
+
+/* struct arenaBlock
+ * One chunk of memory owned by an arena. Blocks are kept in a list with the newest block first.
+ */
+struct arenaBlock{
+	struct arenaBlock *next;//the block that was allocated before this one
+	size_t used;//the number of bytes already handed out from data
+	size_t capacity;//the number of bytes in data
+	char data[];//the memory handed out by arenaAlloc
+};
+
+/* struct arena
+ * Bump allocator for everything that only lives as long as one command (the argument array and expanded words).
+ * Memory grows with the command that is actually being run, and is handed back all at once with arenaReset.
+ */
+struct arena{
+	struct arenaBlock *head;//the block that allocations are currently coming from
+};
+
+/* arenaAlloc(struct arena *, size_t)
+ * Takes an arena and a number of bytes as inputs
+ * Returns a pointer to the new memory
+ * Hands out memory from the current block, adding a new block if there is not enough room left
+ */
+void *arenaAlloc(struct arena *arena, size_t size){
+	size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);//round up so every allocation stays pointer aligned
+	struct arenaBlock *block = arena->head;
+	if(block == NULL || block->capacity - block->used < size){//if there is no block yet, or the current one is full, add a new one
+		size_t capacity = ARENA_BLOCK_SIZE;
+		if(block != NULL){//each new block is double the size of the last one so big commands only need a few blocks
+			capacity = block->capacity * 2;
+		}
+		if(capacity < size){
+			capacity = size;
+		}
+		block = malloc(offsetof(struct arenaBlock, data) + capacity);
+		if(block == NULL){//if there is no memory left, the shell can't keep going
+			printf("Error: out of memory\n");
+			fflush(stdout);
+			exit(1);
+		}
+		block->next = arena->head;
+		block->used = 0;
+		block->capacity = capacity;
+		arena->head = block;
+	}
+	void *result = block->data + block->used;
+	block->used += size;
+	return result;
+}
+
+/* arenaReset(struct arena *)
+ * Takes an arena as input
+ * Returns nothing
+ * Frees every block except the first default sized one, and marks everything in the arena as unused
+ */
+void arenaReset(struct arena *arena){
+	while(arena->head != NULL && (arena->head->next != NULL || arena->head->capacity != ARENA_BLOCK_SIZE)){
+		struct arenaBlock *next = arena->head->next;
+		free(arena->head);
+		arena->head = next;
+	}
+	if(arena->head != NULL){
+		arena->head->used = 0;
+	}
+}
+
+/* arenaFree(struct arena *)
+ * Takes an arena as input
+ * Returns nothing
+ * Frees every block in the arena, for arenas that don't last as long as the shell
+ */
+void arenaFree(struct arena *arena){
+	while(arena->head != NULL){
+		struct arenaBlock *next = arena->head->next;
+		free(arena->head);
+		arena->head = next;
+	}
+}
+
+/* struct inputReader
+ * Where commands are read from. Input is read in big blocks and split into lines in the buffer, so a script doesn't cost a
+ * read call per line. A script given by name is mapped into memory instead, and isn't read at all
+ */
+struct inputReader{
+	int fd;//file descriptor commands are read from
+	char *buffer;//the input that has been read in, or the whole script if it was mapped
+	size_t start;//start of the next line in buffer
+	size_t end;//end of the input in buffer
+	size_t capacity;//size of buffer
+	bool mapped;//if buffer is a memory mapped script
+	bool atEnd;//if there is nothing left to read from fd
+	char *lastLine;//copy of a mapped script's last line when it has no newline, since there is no room to end it in the mapping
+};
+
+/* openReader(struct inputReader *, int)
+ * Takes an input reader and a file descriptor as inputs
+ * Returns nothing
+ * Sets up the reader for the file descriptor, mapping it into memory if it is a regular file that was opened by name
+ */
+void openReader(struct inputReader *reader, int fd){
+	memset(reader, 0, sizeof(struct inputReader));
+	reader->fd = fd;
+	struct stat fileInfo;
+	if(fd != 0 && fstat(fd, &fileInfo) == 0 && S_ISREG(fileInfo.st_mode) && fileInfo.st_size > 0){
+		//private and writable so words can be split in place without changing the file
+		char *mapping = mmap(NULL, fileInfo.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if(mapping != MAP_FAILED){
+			madvise(mapping, fileInfo.st_size, MADV_SEQUENTIAL);
+			reader->buffer = mapping;
+			reader->end = fileInfo.st_size;
+			reader->capacity = fileInfo.st_size;
+			reader->mapped = true;
+			reader->atEnd = true;
+		}
+	}
+}
+
+/* readLine(struct inputReader *, char **)
+ * Takes an input reader and a pointer to a string as inputs
+ * Returns the length of the line, or -1 if there is no more input
+ * Points the string at the next line, with the newline replaced by a null terminator. Lines can be any length,
+ * the buffer grows until the whole line fits
+ */
+int readLine(struct inputReader *reader, char **line){
+	while(true){
+		char *lineStart = reader->buffer + reader->start;
+		char *newline = reader->start < reader->end ? memchr(lineStart, '\n', reader->end - reader->start) : NULL;
+		if(newline != NULL){//a whole line is in the buffer
+			*newline = '\0';
+			reader->start = newline - reader->buffer + 1;
+			*line = lineStart;
+			return newline - lineStart;
+		}
+		if(reader->atEnd){
+			if(reader->start == reader->end){//nothing left at all
+				return -1;
+			}
+			size_t length = reader->end - reader->start;//the last line didn't end with a newline
+			reader->start = reader->end;
+			if(reader->mapped){
+				free(reader->lastLine);
+				reader->lastLine = malloc(length + 1);
+				if(reader->lastLine == NULL){
+					return -1;
+				}
+				memcpy(reader->lastLine, lineStart, length);
+				lineStart = reader->lastLine;
+			}
+			lineStart[length] = '\0';//there is always room for this, reads leave one byte free at the end of the buffer
+			*line = lineStart;
+			return length;
+		}
+
+		//the buffer doesn't have a whole line, so move what is left to the front and read more
+		if(reader->start > 0){
+			memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+			reader->end -= reader->start;
+			reader->start = 0;
+		}
+		if(reader->capacity - reader->end < 2){//full, or this is the first read
+			size_t newCapacity = reader->capacity == 0 ? INPUT_BLOCK_SIZE : reader->capacity * 2;
+			char *newBuffer = realloc(reader->buffer, newCapacity);
+			if(newBuffer == NULL){//if there is no memory left, the shell can't keep going
+				printf("Error: out of memory\n");
+				fflush(stdout);
+				exit(1);
+			}
+			reader->buffer = newBuffer;
+			reader->capacity = newCapacity;
+		}
+		ssize_t numRead = read(reader->fd, reader->buffer + reader->end, reader->capacity - reader->end - 1);
+		if(numRead == -1 && errno == EINTR){//a signal came in, try again
+			continue;
+		}
+		if(numRead <= 0){//end of the input, or it can't be read anymore
+			reader->atEnd = true;
+		}else{
+			reader->end += numRead;
+		}
+	}
+}
 
-/* promptUser(char [], char [])
- * Takes two char arrays as inputs
+/* closeReader(struct inputReader *)
+ * Takes an input reader as input
+ * Returns nothing
+ * Frees or unmaps the reader's buffer and closes its file descriptor, unless it is stdin
+ */
+void closeReader(struct inputReader *reader){
+	if(reader->mapped){
+		munmap(reader->buffer, reader->capacity);
+	}else{
+		free(reader->buffer);
+	}
+	free(reader->lastLine);
+	if(reader->fd != 0){
+		close(reader->fd);
+	}
+}
+
+/* promptUser(char [], struct inputReader *, char **)
+ * Takes a char array, an input reader, and a pointer to a string as inputs
  * Returns an integer
- * Prompts the user for an input, using the promptString to represent the prompt
- * Puts the user input in the outputString array and returns the length of the string
- */
-int promptUser(char promptString[], char outputString[]){
-	//Prints the prompt string to let the user know to type
-	printf("%s",promptString);
-	//Takes the user input, up to MAX_INPUT_LENGTH characters
-	fgets(outputString, MAX_INPUT_LENGTH, stdin);
-	
-	//Creates variable to track number of characters
-	int numCharacters = 0;
-	//Loops through up to MAX_INPUT_LENGTH
-	for(int i = 0; i < MAX_INPUT_LENGTH; i++){
-		//Searches for newline character
-		if(outputString[i] == '\n'){
-			//replaces newline with null terminator
-			outputString[i] = '\0';
-			//sets the number of characters
-			numCharacters = i;
-			break;
+ * Prompts the user for an input, using the promptString to represent the prompt. The prompt is only shown when the shell is interactive.
+ * Points the string at the next line of input and returns the length of the string, or -1 if there is no more input
+ */
+int promptUser(char promptString[], struct inputReader *reader, char **outputString){
+	if(interactive){
+		//Prints the prompt string to let the user know to type
+		printf("%s",promptString);
+		fflush(stdout);
+	}
+	return readLine(reader, outputString);
+}
+
+/* struct historyEntry
+ * One line of history. Lines from earlier sessions point into the mapped history file, new lines have their own copy
+ */
+struct historyEntry{
+	char *text;//not null terminated when it points into the mapped file
+	int length;
+	int previousSameStart;//the newest earlier entry starting with the same character, -1 if there isn't one
+};
+
+/* struct history
+ * Every command run in this shell and the ones before it. The file is only ever appended to, and is mapped once at startup,
+ * so loading it is one pass over memory no matter how big it is. Entries starting with the same character are chained together
+ * so !prefix only looks at commands that could match
+ */
+struct history{
+	int fd;//history file opened for appending, -1 if there isn't one
+	char *map;//the history file as it was when the shell started
+	size_t mapLength;
+	struct historyEntry *entries;//oldest first
+	int numEntries;
+	int numMapped;//number of entries that point into map, they come before the entries from this session
+	int capacity;
+	int lastByStart[256];//newest entry starting with each character, -1 if there isn't one
+};
+
+struct history history = {.fd = -1};
+
+/* addHistoryEntry(char *, int)
+ * Takes the text of a line and its length as inputs
+ * Returns nothing
+ * Adds the line to the end of the in memory history, doubling the entry array when it is full
+ */
+void addHistoryEntry(char *text, int length){
+	if(history.numEntries == history.capacity){
+		int newCapacity = history.capacity == 0 ? 1024 : history.capacity * 2;
+		struct historyEntry *newEntries = realloc(history.entries, newCapacity * sizeof(struct historyEntry));
+		if(newEntries == NULL){//not being able to remember a command isn't worth stopping the shell for
+			return;
+		}
+		history.entries = newEntries;
+		history.capacity = newCapacity;
+	}
+	unsigned char start = text[0];
+	struct historyEntry *entry = &history.entries[history.numEntries];
+	entry->text = text;
+	entry->length = length;
+	entry->previousSameStart = history.lastByStart[start];
+	history.lastByStart[start] = history.numEntries;
+	history.numEntries++;
+}
+
+/* loadHistory()
+ * Takes no inputs
+ * Returns nothing
+ * Opens the history file named by SMALLSH_HISTORY, or ~/.smallsh_history, and maps the lines already in it
+ */
+void loadHistory(){
+	memset(history.lastByStart, -1, sizeof(history.lastByStart));
+	char *path = getenv("SMALLSH_HISTORY");
+	char defaultPath[4096];
+	if(path == NULL){
+		char *home = getenv("HOME");
+		if(home == NULL){
+			return;
+		}
+		snprintf(defaultPath, sizeof(defaultPath), "%s/.smallsh_history", home);
+		path = defaultPath;
+	}
+	history.fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR);
+	if(history.fd == -1){
+		return;
+	}
+	struct stat info;
+	if(fstat(history.fd, &info) == -1 || info.st_size == 0){
+		return;
+	}
+	history.map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, history.fd, 0);
+	if(history.map == MAP_FAILED){
+		history.map = NULL;
+		return;
+	}
+	history.mapLength = info.st_size;
+	madvise(history.map, history.mapLength, MADV_SEQUENTIAL);
+
+	char *line = history.map;
+	char *end = history.map + history.mapLength;
+	while(line < end){
+		char *newline = memchr(line, '\n', end - line);
+		if(newline == NULL){//another shell's last line might not be finished
+			newline = end;
+		}
+		if(newline > line){
+			addHistoryEntry(line, newline - line);
+		}
+		line = newline + 1;
+	}
+	history.numMapped = history.numEntries;
+}
+
+/* recordHistory(char *, int)
+ * Takes a line of input and its length as inputs
+ * Returns nothing
+ * Saves a command typed at the prompt. The line goes to the history file with one O_APPEND write, so lines from shells
+ * running at the same time never get mixed together, and nothing waits on the disk
+ */
+void recordHistory(char *line, int length){
+	if(interactive == false || history.fd == -1){
+		return;
+	}
+	char *text = malloc(length);
+	if(text == NULL){
+		return;
+	}
+	memcpy(text, line, length);
+	addHistoryEntry(text, length);
+	struct iovec parts[2] = {{text, length}, {"\n", 1}};
+	writev(history.fd, parts, 2);
+}
+
+/* expandHistory(char **, int *, struct arena *)
+ * Takes a pointer to a line starting with "!", a pointer to its length, and the command's arena as inputs
+ * Returns false if there is no history entry for it
+ * Replaces "!!" with the last command and "!prefix" with the newest command starting with prefix. The command is copied into
+ * the arena since the words get split in place, and printed so the user can see what is being run
+ */
+bool expandHistory(char **line, int *length, struct arena *arena){
+	char *prefix = *line + 1;
+	int prefixLength = *length - 1;
+	int found = -1;
+	if(strcmp(prefix, "!") == 0){
+		found = history.numEntries - 1;
+	}else{
+		for(int i = history.lastByStart[(unsigned char)prefix[0]]; i != -1; i = history.entries[i].previousSameStart){
+			if(history.entries[i].length >= prefixLength && memcmp(history.entries[i].text, prefix, prefixLength) == 0){
+				found = i;
+				break;
+			}
+		}
+	}
+	if(found == -1){
+		return false;
+	}
+	struct historyEntry *entry = &history.entries[found];
+	char *text = arenaAlloc(arena, entry->length + 1);
+	memcpy(text, entry->text, entry->length);
+	text[entry->length] = '\0';
+	printf("%s\n",text);
+	fflush(stdout);
+	*line = text;
+	*length = entry->length;
+	return true;
+}
+
+/* historyEntryAt(char *)
+ * Takes a pointer into the mapped history file as input
+ * Returns the number of the entry it is in
+ * Binary searches the mapped entries, which are in file order
+ */
+int historyEntryAt(char *position){
+	int low = 0;
+	int high = history.numMapped - 1;
+	while(low < high){
+		int middle = low + (high - low + 1) / 2;
+		if(history.entries[middle].text <= position){
+			low = middle;
+		}else{
+			high = middle - 1;
 		}
 	}
+	return low;
+}
 
-	return numCharacters;
+/* historyCommand(char *[], int)
+ * Takes the arguments for the history builtin and the number of arguments
+ * Returns nothing
+ * "history" lists every command, "history n" lists the last n, and "history -s pattern" lists the commands containing pattern.
+ * A search runs memmem over the whole mapped file at once, then looks up which entry each match is in
+ */
+void historyCommand(char *command[], int numArguments){
+	recentStatus = 0;
+	if(numArguments == 3 && strcmp(command[1], "-s") == 0){
+		char *pattern = command[2];
+		size_t patternLength = strlen(pattern);
+		char *position = history.map;
+		char *end = history.map + history.mapLength;
+		while(position != NULL && position < end && (position = memmem(position, end - position, pattern, patternLength)) != NULL){
+			int i = historyEntryAt(position);
+			printf("%5d  %.*s\n",i + 1,history.entries[i].length,history.entries[i].text);
+			position = history.entries[i].text + history.entries[i].length;//the rest of the line can't match again
+		}
+		for(int i = history.numMapped; i < history.numEntries; i++){
+			if(memmem(history.entries[i].text, history.entries[i].length, pattern, patternLength) != NULL){
+				printf("%5d  %.*s\n",i + 1,history.entries[i].length,history.entries[i].text);
+			}
+		}
+	}else if(numArguments <= 2){
+		int first = 0;
+		if(numArguments == 2){
+			char *end;
+			long count = strtol(command[1], &end, 10);
+			if(*end != '\0' || count < 0){
+				printf("Usage: history [n | -s pattern]\n");
+				fflush(stdout);
+				recentStatus = 1;
+				return;
+			}
+			first = count < history.numEntries ? history.numEntries - count : 0;
+		}
+		for(int i = first; i < history.numEntries; i++){
+			printf("%5d  %.*s\n",i + 1,history.entries[i].length,history.entries[i].text);
+		}
+	}else{
+		printf("Usage: history [n | -s pattern]\n");
+		recentStatus = 1;
+	}
+	fflush(stdout);
 }
 
 /* isBlankOrComment(char [], int)
@@ -75,84 +534,3197 @@ bool isBlankOrComment(char userInput[], int numCharacters){
 		if(userInput[i] == '#'){
 			return true;
 		}
-		//If any other character is found besides '#' and ' ', set that the string is not only spaces
-		if(userInput[i] != ' '){
-			onlySpaces = false;
-			break;
+		//If any other character is found besides '#' and ' ', set that the string is not only spaces
+		if(userInput[i] != ' '){
+			onlySpaces = false;
+			break;
+		}
+	}
+	//return if the string is only spaces
+	return onlySpaces;
+
+}
+
+/* wordEnd(char [], int, int)
+ * Takes a char array, the index a word starts at, and the number of characters as inputs
+ * Returns the index just past the end of the word
+ * A word ends at a space, newline or null terminator, except that spaces inside "$(...)" are part of the word,
+ * so a command substitution stays in one piece until it is expanded
+ */
+int wordEnd(char userInput[], int i, int numCharacters){
+	int depth = 0;//number of "$(" that haven't been closed yet
+	while(i < numCharacters && userInput[i] != '\0' && userInput[i] != '\n' && (userInput[i] != ' ' || depth > 0)){
+		if(userInput[i] == '$' && i + 1 < numCharacters && userInput[i+1] == '('){
+			depth++;
+			i++;
+		}else if(userInput[i] == ')' && depth > 0){
+			depth--;
+		}
+		i++;
+	}
+	return i;
+}
+
+char pipeOperator[] = "|";//the tokenizer points operator words at these, so only words typed as operators are treated as them,
+char inputOperator[] = "<";//never a word that an expansion happened to turn into one
+char outputOperator[] = ">";
+char backgroundOperator[] = "&";
+
+/* operatorWord(char *)
+ * Takes a word as input
+ * Returns the operator the word is, or the word itself if it isn't one
+ */
+char *operatorWord(char *word){
+	if(word[0] != '\0' && word[1] == '\0'){
+		switch(word[0]){
+			case '|': return pipeOperator;
+			case '<': return inputOperator;
+			case '>': return outputOperator;
+			case '&': return backgroundOperator;
+		}
+	}
+	return word;
+}
+
+/* convertToWords(char [], int, struct arena *, char ***)
+ * Takes a char array, an integer, an arena, and a pointer to a string array as inputs
+ * Returns the number of words in the input string
+ * Splits the input in place by putting a null terminator after each word, and points the output array at the words.
+ * The output array comes from the arena and ends with a NULL pointer so it can be passed straight to exec.
+ * "|", "<", ">" and "&" are pointed at the operator strings, which is how the rest of the shell knows them
+ */
+int convertToWords(char userInput[], int numCharacters, struct arena *arena, char ***outputWords){
+	int wordCount = 0;
+	//Count the words first so the output array can be made the right size
+	for(int i = 0; i < numCharacters; i++){
+		//A word starts at any character that isn't a space or newline
+		if(userInput[i] != ' ' && userInput[i] != '\n' && userInput[i] != '\0'){
+			wordCount++;
+			i = wordEnd(userInput, i, numCharacters);
+		}
+	}
+
+	char **words = arenaAlloc(arena, (wordCount + 1) * sizeof(char *));//one extra spot for the NULL at the end
+	int wordNum = 0;
+	//Loops through each character in userInput
+	for(int i = 0; i < numCharacters; i++){
+		//If the character is a space, null terminator, or newline, skip to the next character
+		//This means that the commands will still be successfully pulled even with extra spaces
+		if(userInput[i] != ' ' && userInput[i] != '\0' && userInput[i] != '\n'){
+			words[wordNum] = &userInput[i];//point at the start of the word
+			wordNum++;
+			//skip ahead to the end of the word
+			i = wordEnd(userInput, i, numCharacters);
+			//end the word with a null terminator
+			userInput[i] = '\0';
+			words[wordNum-1] = operatorWord(words[wordNum-1]);
+		}
+	}
+	words[wordNum] = NULL;
+	*outputWords = words;
+	return wordNum;
+}
+
+/* enum traceEvent
+ * The steps of running a command that the trace log records
+ */
+enum traceEvent{
+	TRACE_PARSE_START,//a line is about to be split into words
+	TRACE_PARSE_END,//the line has been split into words
+	TRACE_EXPAND,//the words have been expanded
+	TRACE_FORK,//the fork backend started a child, which will exec on its own
+	TRACE_SPAWN,//the spawn backend started a child and its exec worked
+	TRACE_ZYGOTE,//the zygote started a child and its exec worked
+	TRACE_LAUNCH_FAIL,//a stage couldn't be started, status is the exit value reported for it
+	TRACE_WAIT_START,//the shell started waiting on a foreground job
+	TRACE_WAIT_END,//the foreground job is done, status is its wait status
+	TRACE_REAP//the SIGCHLD handler reaped a child, status is its wait status
+};
+
+char *traceEventNames[] = {"parse_start", "parse_end", "expand", "fork", "spawn", "zygote", "launch_fail", "wait_start", "wait_end", "reap"};
+
+/* struct traceRecord
+ * One entry in the trace ring buffer. Records are kept in binary and only turned into JSON when they are flushed
+ */
+struct traceRecord{
+	long long timestamp;//CLOCK_MONOTONIC time in nanoseconds
+	enum traceEvent event;
+	pid_t pid;//the child the event is about, or the shell's pid
+	int status;//exit value or wait status, depending on the event
+};
+
+bool traceEnabled = false;//if trace records are being kept, set with SMALLSH_TRACE or the trace builtin
+int traceFd = -1;//where the trace log is written
+bool traceFdOwned = false;//if the shell opened traceFd and should close it when tracing is turned off
+struct traceRecord traceRing[TRACE_RING_SIZE];//records waiting to be written
+int traceCount = 0;//number of records in traceRing
+pid_t tracePid = 0;//the pid records about the shell itself are made with, saved once so they don't cost a getpid each
+
+/* flushTrace()
+ * Takes no inputs
+ * Returns nothing
+ * Writes every record in the ring buffer to the trace log as JSON lines, in as few writes as possible
+ */
+void flushTrace(){
+	char chunk[65536];
+	size_t used = 0;
+	for(int i = 0; i < traceCount; i++){
+		if(sizeof(chunk) - used < 128){//each record is well under 128 bytes
+			write(traceFd, chunk, used);
+			used = 0;
+		}
+		used += snprintf(chunk + used, sizeof(chunk) - used, "{\"ts\":%lld,\"event\":\"%s\",\"pid\":%d,\"status\":%d}\n",
+			traceRing[i].timestamp, traceEventNames[traceRing[i].event], (int)traceRing[i].pid, traceRing[i].status);
+	}
+	if(used > 0){
+		write(traceFd, chunk, used);
+	}
+	traceCount = 0;
+}
+
+/* traceEvent(enum traceEvent, pid_t, int, struct timespec *)
+ * Takes an event, a pid, a status, and the time it happened (NULL for now) as inputs
+ * Returns nothing
+ * Adds a record to the trace ring buffer if tracing is on, writing the buffer out when it is full
+ */
+void traceEvent(enum traceEvent event, pid_t pid, int status, struct timespec *when){
+	if(traceEnabled == false){
+		return;
+	}
+	struct timespec now;
+	if(when == NULL){
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		when = &now;
+	}
+	struct traceRecord *record = &traceRing[traceCount];
+	record->timestamp = when->tv_sec * 1000000000LL + when->tv_nsec;
+	record->event = event;
+	record->pid = pid;
+	record->status = status;
+	traceCount++;
+	if(traceCount == TRACE_RING_SIZE){
+		flushTrace();
+	}
+}
+
+/* startTrace(char *)
+ * Takes where to write the trace log as input, either a file path or a file descriptor number
+ * Returns true if tracing was turned on
+ * Opens the trace log, appending to it if it is a file that already exists
+ */
+bool startTrace(char *destination){
+	int fd;
+	bool owned = false;
+	char *end;
+	long number = strtol(destination, &end, 10);
+	if(*destination != '\0' && *end == '\0'){//just digits, so it is a file descriptor that is already open
+		fd = number;
+		if(fcntl(fd, F_GETFD) == -1){
+			return false;
+		}
+	}else{
+		fd = open(destination, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR);
+		if(fd == -1){
+			return false;
+		}
+		owned = true;
+	}
+	if(traceEnabled){//already tracing somewhere else, finish that log first
+		flushTrace();
+		if(traceFdOwned){
+			close(traceFd);
+		}
+	}
+	traceFd = fd;
+	traceFdOwned = owned;
+	traceEnabled = true;
+	return true;
+}
+
+/* stopTrace()
+ * Takes no inputs
+ * Returns nothing
+ * Writes out anything left in the ring buffer and turns tracing off
+ */
+void stopTrace(){
+	if(traceEnabled == false){
+		return;
+	}
+	flushTrace();
+	if(traceFdOwned){
+		close(traceFd);
+	}
+	traceEnabled = false;
+	traceFd = -1;
+}
+
+/* traceCommand(char *[], int)
+ * Takes the arguments for the trace builtin and the number of arguments
+ * Returns nothing
+ * "trace on [file or fd]" starts the trace log (smallsh.trace by default), "trace off" stops it, and "trace" shows if it is on
+ */
+void traceCommand(char *command[], int numArguments){
+	recentStatus = 0;
+	if(numArguments == 1){
+		printf("trace is %s\n",traceEnabled ? "on" : "off");
+		fflush(stdout);
+	}else if(strcmp(command[1], "on") == 0 && numArguments <= 3){
+		char *destination = numArguments == 3 ? command[2] : "smallsh.trace";
+		if(startTrace(destination) == false){
+			printf("Error opening trace log \"%s\"\n",destination);
+			fflush(stdout);
+			recentStatus = 1;
+		}
+	}else if(strcmp(command[1], "off") == 0 && numArguments == 2){
+		stopTrace();
+	}else{
+		printf("Usage: trace [on [file or fd] | off]\n");
+		fflush(stdout);
+		recentStatus = 1;
+	}
+}
+
+//handle_SIGINT
+//SIGINT should just exit if passed
+void handle_SIGINT(int signo){
+	exit(2);
+}
+
+//handle_SIGINT_wait
+//SIGINT stops the wait builtin, the shell ignores it the rest of the time
+void handle_SIGINT_wait(int signo){
+	waitInterrupted = 1;
+}
+
+//handleSIGTSTP
+//SIGTSTP will toggle the foreground only mode for the shell, and let the main function know to print the change
+void handle_SIGTSTP(int signo){
+
+	if(foregroundOnly){//toggle foregroundOnly
+		foregroundOnly = false;
+	}else{
+		foregroundOnly = true;
+	}
+	modeChanged = true;//set modeChanged to true so the main function will print a message.
+
+}
+
+/* struct reapedChild
+ * A child that the SIGCHLD handler has already waited on, waiting for the main code to look at its status
+ */
+struct reapedChild{
+	pid_t pid;//pid of the child that finished
+	int status;//status from wait4
+	struct rusage usage;//CPU time, max RSS, and context switches of the child
+	struct timespec reapTime;//CLOCK_MONOTONIC time the child was reaped
+};
+
+struct reapedChild reapQueue[REAP_QUEUE_SIZE];//children reaped by the SIGCHLD handler, handled in order by collectChildren
+volatile sig_atomic_t reapHead = 0;//next spot in reapQueue for collectChildren to read, only changed with SIGCHLD blocked
+volatile sig_atomic_t reapTail = 0;//next spot in reapQueue for reapChildren to fill
+
+/* reapChildren()
+ * Takes no inputs
+ * Returns nothing
+ * Waits on every child that has finished, stopped or continued, and adds it and its resource usage to reapQueue. Called from the SIGCHLD handler, so it only uses async signal safe calls.
+ * If the queue fills up the rest of the children are left for the next call
+ */
+void reapChildren(){
+	int savedErrno = errno;//wait4 can change errno under whatever the main code was doing
+	while((reapTail + 1) % REAP_QUEUE_SIZE != reapHead){//stop if the queue is full
+		int childStatus;
+		pid_t childPid = wait4(-1, &childStatus, WNOHANG | WUNTRACED | WCONTINUED, &reapQueue[reapTail].usage);//wait for any child, immediatly returning 0 if none have changed
+		if(childPid <= 0){
+			break;
+		}
+		reapQueue[reapTail].pid = childPid;
+		reapQueue[reapTail].status = childStatus;
+		clock_gettime(CLOCK_MONOTONIC, &reapQueue[reapTail].reapTime);
+		reapTail = (reapTail + 1) % REAP_QUEUE_SIZE;
+	}
+	errno = savedErrno;
+}
+
+//handle_SIGCHLD
+//SIGCHLD reaps children as soon as they finish, so they don't sit around as zombies until the next prompt
+void handle_SIGCHLD(int signo){
+	reapChildren();
+}
+
+/* struct stage
+ * One command in a pipeline, along with where its input and output come from
+ */
+struct stage{
+	char **command;//NULL terminated arguments for exec, pointing into the full argument array
+	int numArguments;//number of arguments in command
+	char *inputFile;//file to redirect input from, NULL if there is no "<"
+	char *outputFile;//file to redirect output to, NULL if there is no ">"
+	int inFd;//read end of the pipe from the stage before this one, -1 for the first stage
+	int outFd;//write end of the pipe to the next stage, -1 for the last stage
+	int launchError;//exit value to report if the stage couldn't be started
+};
+
+/* findRedirections(char *[], int *, char **, char **)
+ * Takes an array of arguments, a pointer to the number of arguments, and pointers to the input and output file paths
+ * Returns nothing
+ * Looks anywhere in the command for "<" and ">" followed by a file path, and pulls them off of the argument list.
+ * Only the first of each is used, any others are dropped
+ */
+void findRedirections(char *command[], int *numArguments, char **inputFile, char **outputFile){
+	int numKept = 0;//number of arguments that aren't part of a redirection
+	for(int i = 0; i < *numArguments; i++){
+		if(i + 1 < *numArguments && command[i] == outputOperator){//check if the output redirection symbol is found, the file path is the next argument
+			if(*outputFile == NULL){
+				*outputFile = command[i+1];
+			}
+			i++;//skip over the file path
+		}else if(i + 1 < *numArguments && command[i] == inputOperator){//check if the input redirection symbol is found
+			if(*inputFile == NULL){
+				*inputFile = command[i+1];
+			}
+			i++;
+		}else{
+			command[numKept] = command[i];//slide the argument down over any redirections before it
+			numKept++;
+		}
+	}
+	*numArguments = numKept;
+	command[numKept] = NULL;//end the array after the last argument, cutting off any redirection or "&"
+}
+
+/* splitPipeline(char *[], int, struct arena *, struct stage **)
+ * Takes an array of arguments, the number of arguments, an arena, and a pointer to a stage array as inputs
+ * Returns the number of stages, or -1 if one of the stages has no command
+ * Splits the arguments on "|" into stages, and finds the redirections for each stage. The stage array comes from the arena
+ */
+int splitPipeline(char *command[], int numArguments, struct arena *arena, struct stage **outputStages){
+	int numStages = 1;
+	for(int i = 0; i < numArguments; i++){
+		if(command[i] == pipeOperator){
+			numStages++;
+		}
+	}
+	struct stage *stages = arenaAlloc(arena, numStages * sizeof(struct stage));
+	int stageNum = 0;
+	int stageStart = 0;
+	for(int i = 0; i <= numArguments; i++){
+		if(i == numArguments || command[i] == pipeOperator){//the end of a stage
+			struct stage *stage = &stages[stageNum];
+			stage->command = &command[stageStart];
+			stage->numArguments = i - stageStart;
+			stage->inputFile = NULL;
+			stage->outputFile = NULL;
+			stage->inFd = -1;
+			stage->outFd = -1;
+			stage->launchError = 0;
+			findRedirections(stage->command, &stage->numArguments, &stage->inputFile, &stage->outputFile);//this also puts a NULL over the "|"
+			if(stage->numArguments == 0){
+				return -1;
+			}
+			stageNum++;
+			stageStart = i + 1;
+		}
+	}
+	*outputStages = stages;
+	return numStages;
+}
+
+/* struct environment
+ * The shell's own copy of its environment. variables is a null terminated array of "NAME=value" strings in the order they were
+ * first set, so it is handed to posix_spawn and execve as it is. It only changes when export, unset or cd change a variable,
+ * so launching a command never scans or copies the environment
+ */
+struct environment{
+	char **variables;//the envp every command is started with, each string is malloc'd
+	int numVariables;
+	int capacity;//slots in variables, not counting the NULL at the end
+	unsigned long generation;//counts changes, so the zygote knows when its copy is out of date
+	unsigned long pathGeneration;//counts changes to PATH, so the PATH cache knows when to empty itself
+	char *directory;//the current directory, found once per cd instead of once per launch, NULL if it couldn't be found
+};
+
+struct environment environment = {0};//the environment every command is started with
+
+/* findVariable(char *, size_t)
+ * Takes a variable name and its length as inputs
+ * Returns the variable's index in the environment, or -1 if it isn't set
+ */
+int findVariable(char *name, size_t nameLength){
+	for(int i = 0; i < environment.numVariables; i++){
+		if(strncmp(environment.variables[i], name, nameLength) == 0 && environment.variables[i][nameLength] == '='){
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* getVariable(char *, size_t)
+ * Takes a variable name and its length as inputs, the name doesn't have to be null terminated
+ * Returns the variable's value, or NULL if it isn't set. The value is only good until the variable next changes
+ */
+char *getVariable(char *name, size_t nameLength){
+	int i = findVariable(name, nameLength);
+	return i == -1 ? NULL : environment.variables[i] + nameLength + 1;
+}
+
+/* setVariable(char *, size_t, char *)
+ * Takes a variable name, its length, and a value as inputs
+ * Returns true if the variable was set, false if there is no memory for it
+ * Sets the variable in the shell's environment, replacing it in place if it is already set
+ */
+bool setVariable(char *name, size_t nameLength, char *value){
+	size_t valueLength = strlen(value);
+	char *variable = malloc(nameLength + valueLength + 2);
+	if(variable == NULL){
+		return false;
+	}
+	memcpy(variable, name, nameLength);
+	variable[nameLength] = '=';
+	memcpy(variable + nameLength + 1, value, valueLength + 1);
+
+	int i = findVariable(name, nameLength);
+	if(i == -1){
+		if(environment.numVariables >= environment.capacity){
+			int newCapacity = environment.capacity == 0 ? 64 : environment.capacity * 2;
+			char **newVariables = realloc(environment.variables, (newCapacity + 1) * sizeof(char *));
+			if(newVariables == NULL){
+				free(variable);
+				return false;
+			}
+			environment.variables = newVariables;
+			environment.capacity = newCapacity;
+			environ = newVariables;//keep getenv and execvp looking at the same variables as the shell
+		}
+		i = environment.numVariables;
+		environment.numVariables++;
+		environment.variables[environment.numVariables] = NULL;
+	}else{
+		free(environment.variables[i]);
+	}
+	environment.variables[i] = variable;
+	environment.generation++;
+	if(nameLength == 4 && strncmp(name, "PATH", 4) == 0){
+		environment.pathGeneration++;
+	}
+	return true;
+}
+
+/* unsetVariable(char *, size_t)
+ * Takes a variable name and its length as inputs
+ * Returns nothing
+ * Removes the variable from the shell's environment, keeping the others in order
+ */
+void unsetVariable(char *name, size_t nameLength){
+	int i = findVariable(name, nameLength);
+	if(i == -1){
+		return;
+	}
+	free(environment.variables[i]);
+	memmove(&environment.variables[i], &environment.variables[i + 1], (environment.numVariables - i) * sizeof(char *));//the NULL moves down too
+	environment.numVariables--;
+	environment.generation++;
+	if(nameLength == 4 && strncmp(name, "PATH", 4) == 0){
+		environment.pathGeneration++;
+	}
+}
+
+/* validName(char *, size_t)
+ * Takes a variable name and its length as inputs
+ * Returns true if the name is letters, digits and underscores and doesn't start with a digit
+ */
+bool validName(char *name, size_t nameLength){
+	if(nameLength == 0 || (name[0] >= '0' && name[0] <= '9')){
+		return false;
+	}
+	for(size_t i = 0; i < nameLength; i++){
+		if(name[i] != '_' && !(name[i] >= 'A' && name[i] <= 'Z') && !(name[i] >= 'a' && name[i] <= 'z') && !(name[i] >= '0' && name[i] <= '9')){
+			return false;
+		}
+	}
+	return true;
+}
+
+/* initEnvironment()
+ * Takes no inputs
+ * Returns nothing
+ * Copies the environment the shell was started with into the shell's own table, and finds the current directory,
+ * keeping PWD if it already names it
+ */
+void initEnvironment(){
+	char **inherited = environ;//setVariable points environ at the table, so walk the original array
+	for(int i = 0; inherited[i] != NULL; i++){
+		char *equals = strchr(inherited[i], '=');
+		if(equals != NULL){
+			setVariable(inherited[i], equals - inherited[i], equals + 1);
+		}
+	}
+	if(environment.variables == NULL){//an empty environment still needs an envp
+		environment.variables = calloc(1, sizeof(char *));
+		environ = environment.variables;
+	}
+
+	char *pwd = getVariable("PWD", 3);
+	struct stat pwdInfo;
+	struct stat dotInfo;
+	if(pwd != NULL && pwd[0] == '/' && stat(pwd, &pwdInfo) == 0 && stat(".", &dotInfo) == 0 && pwdInfo.st_dev == dotInfo.st_dev && pwdInfo.st_ino == dotInfo.st_ino){
+		environment.directory = strdup(pwd);
+	}else{
+		environment.directory = getcwd(NULL, 0);
+		if(environment.directory != NULL){
+			setVariable("PWD", 3, environment.directory);
+		}
+	}
+}
+
+/* changeDirectory(char *)
+ * Takes a directory as input
+ * Returns true if the shell is now in that directory
+ * Changes directory and updates PWD and OLDPWD
+ */
+bool changeDirectory(char *path){
+	if(chdir(path) == -1){
+		return false;
+	}
+	char *newDirectory = getcwd(NULL, 0);
+	if(environment.directory != NULL){
+		setVariable("OLDPWD", 6, environment.directory);
+	}
+	free(environment.directory);
+	environment.directory = newDirectory;
+	if(newDirectory != NULL){
+		setVariable("PWD", 3, newDirectory);
+	}
+	return true;
+}
+
+/* exportCommand(char *[], int)
+ * Takes an array of strings and an int as inputs
+ * Returns nothing
+ * export NAME=value sets each variable for the shell and every command it starts, export NAME keeps a variable that is
+ * already set, and export by itself lists the environment
+ */
+void exportCommand(char *command[], int numArguments){
+	recentStatus = 0;
+	if(numArguments == 1){
+		for(int i = 0; i < environment.numVariables; i++){
+			printf("export %s\n",environment.variables[i]);
+		}
+		fflush(stdout);
+		return;
+	}
+	for(int i = 1; i < numArguments; i++){
+		char *equals = strchr(command[i], '=');
+		size_t nameLength = equals == NULL ? strlen(command[i]) : (size_t)(equals - command[i]);
+		if(validName(command[i], nameLength) == false){
+			printf("Error: not a valid variable name \"%.*s\"\n",(int)nameLength,command[i]);
+			fflush(stdout);
+			recentStatus = 1;
+		}else if(equals != NULL && setVariable(command[i], nameLength, equals + 1) == false){
+			printf("Error: out of memory setting \"%.*s\"\n",(int)nameLength,command[i]);
+			fflush(stdout);
+			recentStatus = 1;
+		}
+	}
+}
+
+/* unsetCommand(char *[], int)
+ * Takes an array of strings and an int as inputs
+ * Returns nothing
+ * Removes each named variable from the environment
+ */
+void unsetCommand(char *command[], int numArguments){
+	recentStatus = 0;
+	for(int i = 1; i < numArguments; i++){
+		size_t nameLength = strlen(command[i]);
+		if(validName(command[i], nameLength) == false){
+			printf("Error: not a valid variable name \"%s\"\n",command[i]);
+			fflush(stdout);
+			recentStatus = 1;
+		}else{
+			unsetVariable(command[i], nameLength);
+		}
+	}
+}
+
+/* struct pathEntry
+ * One command in the PATH cache, chained with the other commands in the same bucket
+ */
+struct pathEntry{
+	char *name;//the command as it was typed
+	char *path;//the absolute path PATH resolved it to
+	int hits;//number of times the entry has been used, shown by the hash builtin
+	struct pathEntry *next;//next entry in the same bucket
+};
+
+/* struct pathCache
+ * Hash from command names to where they were found in PATH, so launching the same command again doesn't walk PATH.
+ * The whole cache is thrown out when PATH changes
+ */
+struct pathCache{
+	struct pathEntry **buckets;//chains of entries, the number of buckets is always a power of 2
+	int numBuckets;
+	int numEntries;
+	unsigned long pathGeneration;//the PATH generation the entries were found with
+	char *scratch;//holds a result that can't be cached because it came from a relative PATH directory
+};
+
+struct pathCache pathCache = {0};//the shell's PATH cache, shared by both launch backends
+
+/* nameHash(char *)
+ * Takes a string as input
+ * Returns a hash of the string
+ */
+unsigned int nameHash(char *name){
+	unsigned int hash = 2166136261u;//FNV-1a
+	for(int i = 0; name[i] != '\0'; i++){
+		hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+	}
+	return hash;
+}
+
+/* clearPathCache()
+ * Takes no inputs
+ * Returns nothing
+ * Frees every entry in the PATH cache
+ */
+void clearPathCache(){
+	for(int i = 0; i < pathCache.numBuckets; i++){
+		struct pathEntry *entry = pathCache.buckets[i];
+		while(entry != NULL){
+			struct pathEntry *next = entry->next;
+			free(entry->name);
+			free(entry->path);
+			free(entry);
+			entry = next;
+		}
+		pathCache.buckets[i] = NULL;
+	}
+	pathCache.numEntries = 0;
+}
+
+/* forgetCommand(char *)
+ * Takes a command name as input
+ * Returns nothing
+ * Removes the command from the PATH cache, used when its cached path stops working
+ */
+void forgetCommand(char *name){
+	if(pathCache.numBuckets == 0){
+		return;
+	}
+	struct pathEntry **link = &pathCache.buckets[nameHash(name) & (pathCache.numBuckets - 1)];
+	while(*link != NULL){
+		if(strcmp((*link)->name, name) == 0){
+			struct pathEntry *entry = *link;
+			*link = entry->next;
+			free(entry->name);
+			free(entry->path);
+			free(entry);
+			pathCache.numEntries--;
+			return;
+		}
+		link = &(*link)->next;
+	}
+}
+
+/* cacheCommand(char *, char *)
+ * Takes a command name and the path it was found at as inputs
+ * Returns the cached copy of the path, or NULL if there is no memory for it
+ * Adds the command to the PATH cache, doubling the number of buckets when there are more entries than buckets
+ */
+char *cacheCommand(char *name, char *path){
+	if(pathCache.numEntries >= pathCache.numBuckets){
+		int newNumBuckets = pathCache.numBuckets == 0 ? 64 : pathCache.numBuckets * 2;
+		struct pathEntry **newBuckets = calloc(newNumBuckets, sizeof(struct pathEntry *));
+		if(newBuckets == NULL){
+			return NULL;
+		}
+		for(int i = 0; i < pathCache.numBuckets; i++){//move every entry into its new bucket
+			struct pathEntry *entry = pathCache.buckets[i];
+			while(entry != NULL){
+				struct pathEntry *next = entry->next;
+				int bucket = nameHash(entry->name) & (newNumBuckets - 1);
+				entry->next = newBuckets[bucket];
+				newBuckets[bucket] = entry;
+				entry = next;
+			}
+		}
+		free(pathCache.buckets);
+		pathCache.buckets = newBuckets;
+		pathCache.numBuckets = newNumBuckets;
+	}
+	struct pathEntry *entry = malloc(sizeof(struct pathEntry));
+	char *nameCopy = strdup(name);
+	char *pathCopy = strdup(path);
+	if(entry == NULL || nameCopy == NULL || pathCopy == NULL){
+		free(entry);
+		free(nameCopy);
+		free(pathCopy);
+		return NULL;
+	}
+	int bucket = nameHash(name) & (pathCache.numBuckets - 1);
+	entry->name = nameCopy;
+	entry->path = pathCopy;
+	entry->hits = 0;
+	entry->next = pathCache.buckets[bucket];
+	pathCache.buckets[bucket] = entry;
+	pathCache.numEntries++;
+	return pathCopy;
+}
+
+/* findCommand(char *)
+ * Takes a command name as input
+ * Returns the path to exec for the command, or NULL if it isn't in PATH
+ * Names with a "/" in them are used as they are. Anything else is looked up in the PATH cache first, and only if it isn't there
+ * is each directory in PATH checked. The returned string belongs to the cache and is only good until the next lookup
+ */
+char *findCommand(char *name){
+	if(strchr(name, '/') != NULL){//already a path, nothing to look up
+		return name;
+	}
+
+	if(pathCache.pathGeneration != environment.pathGeneration){//PATH changed, so none of the cached paths can be trusted
+		clearPathCache();
+		pathCache.pathGeneration = environment.pathGeneration;
+	}
+
+	if(pathCache.numBuckets > 0){
+		for(struct pathEntry *entry = pathCache.buckets[nameHash(name) & (pathCache.numBuckets - 1)]; entry != NULL; entry = entry->next){
+			if(strcmp(entry->name, name) == 0){
+				entry->hits++;
+				return entry->path;
+			}
+		}
+	}
+
+	char *path = getVariable("PATH", 4);
+	if(path == NULL){
+		path = "/bin:/usr/bin";//same default execvp uses
+	}
+	size_t nameLength = strlen(name);
+	char *directory = path;
+	while(true){//check each directory in PATH, in order
+		char *directoryEnd = strchr(directory, ':');
+		size_t directoryLength = directoryEnd == NULL ? strlen(directory) : (size_t)(directoryEnd - directory);
+		char *candidate = malloc(directoryLength + nameLength + 3);
+		if(candidate == NULL){
+			return NULL;
+		}
+		if(directoryLength == 0){//an empty entry in PATH means the current directory
+			strcpy(candidate, "./");
+		}else{
+			memcpy(candidate, directory, directoryLength);
+			candidate[directoryLength] = '/';
+			candidate[directoryLength+1] = '\0';
+		}
+		strcat(candidate, name);
+
+		struct stat fileInfo;
+		if(stat(candidate, &fileInfo) == 0 && S_ISREG(fileInfo.st_mode) && access(candidate, X_OK) == 0){
+			char *result = NULL;
+			if(candidate[0] == '/'){//only absolute paths are cached, a relative one would break after cd
+				result = cacheCommand(name, candidate);
+				if(result != NULL){
+					free(candidate);
+					return result;
+				}
+			}
+			free(pathCache.scratch);
+			pathCache.scratch = candidate;
+			return candidate;
+		}
+		free(candidate);
+
+		if(directoryEnd == NULL){
+			return NULL;
+		}
+		directory = directoryEnd + 1;
+	}
+}
+
+/* hashCommand(char *[], int)
+ * Takes the arguments for the hash builtin and the number of arguments
+ * Returns nothing
+ * With no arguments lists the PATH cache, "hash -r" empties it, and "hash name..." looks the names up and adds them to it
+ */
+void hashCommand(char *command[], int numArguments){
+	if(numArguments == 1){
+		if(pathCache.numEntries == 0){
+			printf("hash: hash table empty\n");
+		}else{
+			printf("hits\tcommand\n");
+			for(int i = 0; i < pathCache.numBuckets; i++){
+				for(struct pathEntry *entry = pathCache.buckets[i]; entry != NULL; entry = entry->next){
+					printf("%4d\t%s\n",entry->hits,entry->path);
+				}
+			}
+		}
+		fflush(stdout);
+		recentStatus = 0;
+		return;
+	}
+	if(strcmp(command[1], "-r") == 0){
+		if(numArguments > 2){
+			printf("Error: too many arguments for command \"hash -r\"\n");
+			fflush(stdout);
+			recentStatus = 1;
+			return;
+		}
+		clearPathCache();
+		recentStatus = 0;
+		return;
+	}
+	recentStatus = 0;
+	for(int i = 1; i < numArguments; i++){
+		char *path = findCommand(command[i]);
+		if(path == NULL){
+			printf("hash: %s: not found\n",command[i]);
+			fflush(stdout);
+			recentStatus = 1;
+		}
+	}
+}
+
+/* writeAll(int, char *, size_t)
+ * Takes a file descriptor, a buffer, and the number of bytes in it as inputs
+ * Returns 0 if every byte was written, or -1 if writing failed
+ * Keeps writing until the whole buffer is out, since writes to pipes and sockets can be short
+ */
+int writeAll(int fd, char *buffer, size_t length){
+	while(length > 0){
+		ssize_t written = write(fd, buffer, length);
+		if(written == -1){
+			if(errno == EINTR){
+				continue;
+			}
+			return -1;
+		}
+		buffer += written;
+		length -= written;
+	}
+	return 0;
+}
+
+/* kernelCopyFailed(int)
+ * Takes an errno value from copy_file_range, splice or sendfile as input
+ * Returns true if it means the call can't be used on these files, so the copy should try the next way instead
+ */
+bool kernelCopyFailed(int error){
+	return error == EINVAL || error == ENOSYS || error == EXDEV || error == EBADF || error == EOPNOTSUPP || error == ESPIPE;
+}
+
+/* moveData(int, int)
+ * Takes a file descriptor to read from and one to write to as inputs
+ * Returns 0 if everything was copied, or -1 if reading or writing failed
+ * Moves the data without bringing it into the shell when it can: copy_file_range between regular files, splice when either end is a pipe,
+ * and sendfile from a regular file to anything else. Each of these uses and moves the fds' own offsets, so if one gives up partway
+ * the next one carries on from the same spot, ending with a plain read/write loop
+ */
+int moveData(int inFd, int outFd){
+	struct stat inInfo, outInfo;
+	if(fstat(inFd, &inInfo) == -1 || fstat(outFd, &outInfo) == -1){
+		return -1;
+	}
+	ssize_t moved;
+	//files in /proc and /sys say they are empty, and only a read gets their contents
+	bool inRegular = S_ISREG(inInfo.st_mode) && inInfo.st_size > 0;
+
+	if(inRegular && S_ISREG(outInfo.st_mode)){
+		while((moved = copy_file_range(inFd, NULL, outFd, NULL, COPY_CHUNK_SIZE, 0)) > 0);
+		if(moved == 0){
+			return 0;
+		}
+		if(kernelCopyFailed(errno) == false){
+			return -1;
+		}
+	}
+	if(S_ISFIFO(inInfo.st_mode) || S_ISFIFO(outInfo.st_mode)){
+		while((moved = splice(inFd, NULL, outFd, NULL, COPY_CHUNK_SIZE, SPLICE_F_MOVE)) > 0);
+		if(moved == 0){
+			return 0;
+		}
+		if(kernelCopyFailed(errno) == false){
+			return -1;
+		}
+	}
+	if(inRegular){
+		while((moved = sendfile(outFd, inFd, NULL, COPY_CHUNK_SIZE)) > 0);
+		if(moved == 0){
+			return 0;
+		}
+		if(kernelCopyFailed(errno) == false){
+			return -1;
+		}
+	}
+
+	static char buffer[COPY_BUFFER_SIZE];//only used by one copy at a time, and too big for the stack
+	while((moved = read(inFd, buffer, sizeof(buffer))) != 0){
+		if(moved == -1){
+			if(errno == EINTR){
+				continue;
+			}
+			return -1;
+		}
+		if(writeAll(outFd, buffer, moved) == -1){
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* catCommand(struct stage *)
+ * Takes a stage running cat as input
+ * Returns true if cat was run in the shell, or false if it has to be run as a normal command
+ * Runs "cat [file...] [< file] [> file]" without starting a process. Options, and inputs that aren't regular files (which could block
+ * forever, and the shell ignores ^C), are left to the real cat, as is cat with nothing to read but the terminal. So is cat writing
+ * to the terminal or to anything but a regular file, since only the real cat can be stopped with ^C part way through
+ */
+bool catCommand(struct stage *stage){
+	char **command = stage->command;
+	int numArguments = stage->numArguments;
+	if(numArguments == 1 && stage->inputFile == NULL){
+		return false;
+	}
+	struct stat info;
+	for(int i = 1; i < numArguments; i++){
+		if(command[i][0] == '-'){
+			return false;
+		}
+		if(stat(command[i], &info) == 0 && S_ISREG(info.st_mode) == false){
+			return false;
+		}
+	}
+	if(numArguments == 1 && stat(stage->inputFile, &info) == 0 && S_ISREG(info.st_mode) == false){
+		return false;
+	}
+	//a big file going to the terminal has to be stoppable with ^C, and opening a FIFO to write to could block the shell
+	if(stage->outputFile == NULL ? isatty(1) : (stat(stage->outputFile, &info) == 0 && S_ISREG(info.st_mode) == false)){
+		return false;
+	}
+
+	int outFd = 1;
+	if(stage->outputFile != NULL){
+		outFd = open(stage->outputFile, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+		if(outFd == -1){
+			printf("Error opening file \"%s\"\n",stage->outputFile);
+			fflush(stdout);
+			recentStatus = 1;
+			return true;
+		}
+	}else{
+		fflush(stdout);//anything the shell printed has to come out before the file
+	}
+
+	recentStatus = 0;
+	int first = 1;
+	int last = numArguments - 1;
+	if(numArguments == 1){//no files, so cat reads the input redirection
+		command = &stage->inputFile;
+		first = 0;
+		last = 0;
+	}
+	for(int i = first; i <= last; i++){
+		int inFd = open(command[i], O_RDONLY | O_CLOEXEC);
+		if(inFd == -1){
+			printf("Error opening file \"%s\"\n",command[i]);
+			fflush(stdout);
+			recentStatus = 1;
+			continue;
+		}
+		if(moveData(inFd, outFd) == -1){
+			printf("Error copying \"%s\"\n",command[i]);
+			fflush(stdout);
+			recentStatus = 1;
+		}
+		close(inFd);
+	}
+
+	if(outFd != 1){
+		close(outFd);
+	}
+	return true;
+}
+
+/* copyCommand(char *[], int, struct arena *)
+ * Takes the arguments for the copy builtin, the number of arguments, and the command's arena as inputs
+ * Returns nothing
+ * "copy source destination" copies a file, keeping its permissions. If the destination is a directory the copy goes inside it
+ */
+void copyCommand(char *command[], int numArguments, struct arena *arena){
+	recentStatus = 1;
+	if(numArguments != 3){
+		printf("Usage: copy source destination\n");
+		fflush(stdout);
+		return;
+	}
+	char *source = command[1];
+	char *destination = command[2];
+	int inFd = open(source, O_RDONLY | O_CLOEXEC);
+	struct stat sourceInfo, destinationInfo;
+	if(inFd == -1 || fstat(inFd, &sourceInfo) == -1){
+		printf("Error opening file \"%s\"\n",source);
+		fflush(stdout);
+		if(inFd != -1){
+			close(inFd);
+		}
+		return;
+	}
+	if(S_ISDIR(sourceInfo.st_mode)){
+		printf("Error: \"%s\" is a directory\n",source);
+		fflush(stdout);
+		close(inFd);
+		return;
+	}
+
+	if(stat(destination, &destinationInfo) == 0 && S_ISDIR(destinationInfo.st_mode)){//copy into the directory under the same name
+		char *name = strrchr(source, '/');
+		name = name == NULL ? source : name + 1;
+		size_t length = strlen(destination) + strlen(name) + 2;
+		char *path = arenaAlloc(arena, length);
+		snprintf(path, length, "%s/%s", destination, name);
+		destination = path;
+	}
+	if(stat(destination, &destinationInfo) == 0 && destinationInfo.st_dev == sourceInfo.st_dev && destinationInfo.st_ino == sourceInfo.st_ino){
+		printf("Error: \"%s\" and \"%s\" are the same file\n",source,destination);//opening it would empty it before it is read
+		fflush(stdout);
+		close(inFd);
+		return;
+	}
+
+	int outFd = open(destination, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, sourceInfo.st_mode & 0777);
+	if(outFd == -1){
+		printf("Error opening file \"%s\"\n",destination);
+		fflush(stdout);
+		close(inFd);
+		return;
+	}
+	if(moveData(inFd, outFd) == -1){
+		printf("Error copying \"%s\" to \"%s\"\n",source,destination);
+		fflush(stdout);
+	}else{
+		recentStatus = 0;
+	}
+	close(inFd);
+	close(outFd);
+}
+
+/* struct launchOptions
+ * Limits from the with prefix, applied in the child between fork and exec
+ */
+struct launchOptions{
+	bool hasCpus;
+	cpu_set_t cpus;//CPUs the command may run on
+	bool hasNice;
+	int nice;//niceness to run the command at
+	int numLimits;
+	int limitResources[LAUNCH_MAX_LIMITS];//RLIMIT_ values to set
+	rlim_t limitValues[LAUNCH_MAX_LIMITS];//what to set each one to, for both the soft and hard limit
+	bool hasIoClass;
+	int ioPriority;//I/O class and level packed the way ioprio_set takes them
+	char description[256];//what was applied, for the job table and the status command
+};
+
+/* struct limitName
+ * A name --rlimit accepts and the resource it sets
+ */
+struct limitName{
+	char *name;
+	int resource;
+};
+
+struct limitName limitNames[] = {{"as", RLIMIT_AS}, {"core", RLIMIT_CORE}, {"cpu", RLIMIT_CPU}, {"data", RLIMIT_DATA}, {"fsize", RLIMIT_FSIZE},
+	{"memlock", RLIMIT_MEMLOCK}, {"nofile", RLIMIT_NOFILE}, {"nproc", RLIMIT_NPROC}, {"stack", RLIMIT_STACK}};
+
+/* parseCpuList(char *, cpu_set_t *)
+ * Takes a list of CPUs like "0-3,6" and a CPU set as inputs
+ * Returns false if the list can't be read
+ */
+bool parseCpuList(char *text, cpu_set_t *cpus){
+	CPU_ZERO(cpus);
+	while(true){
+		char *end;
+		long first = strtol(text, &end, 10);
+		long last = first;
+		if(end == text){
+			return false;
+		}
+		if(*end == '-'){
+			text = end + 1;
+			last = strtol(text, &end, 10);
+			if(end == text){
+				return false;
+			}
+		}
+		if(first < 0 || last < first || last >= CPU_SETSIZE){
+			return false;
+		}
+		for(long cpu = first; cpu <= last; cpu++){
+			CPU_SET(cpu, cpus);
+		}
+		if(*end == '\0'){
+			return true;
+		}
+		if(*end != ','){
+			return false;
+		}
+		text = end + 1;
+	}
+}
+
+/* parseLimitValue(char *, rlim_t *)
+ * Takes a limit like "2G", "512K", "100" or "unlimited" and a pointer to where the value goes as inputs
+ * Returns false if the limit can't be read. K, M, G and T are powers of 1024
+ */
+bool parseLimitValue(char *text, rlim_t *value){
+	if(strcmp(text, "unlimited") == 0){
+		*value = RLIM_INFINITY;
+		return true;
+	}
+	char *end;
+	unsigned long long number = strtoull(text, &end, 10);
+	if(end == text || *text == '-'){
+		return false;
+	}
+	int shift = 0;
+	if(*end == 'K' || *end == 'k'){
+		shift = 10;
+	}else if(*end == 'M' || *end == 'm'){
+		shift = 20;
+	}else if(*end == 'G' || *end == 'g'){
+		shift = 30;
+	}else if(*end == 'T' || *end == 't'){
+		shift = 40;
+	}
+	if(shift != 0){
+		end++;
+	}
+	if(*end != '\0' || (shift != 0 && number > (~0ULL >> shift))){
+		return false;
+	}
+	*value = number << shift;
+	return true;
+}
+
+/* describeOption(struct launchOptions *, char *, char *, int)
+ * Takes launch options, the name to show an option as, its value, and the length of the value as inputs
+ * Returns nothing
+ * Adds "name=value" to the end of the options' description, cutting it off if it gets too long
+ */
+void describeOption(struct launchOptions *options, char *name, char *value, int valueLength){
+	size_t used = strlen(options->description);
+	snprintf(options->description + used, sizeof(options->description) - used, "%s%s%.*s",used > 0 ? " " : "",name,valueLength,value);
+}
+
+/* parseLaunchOptions(char *[], int, struct launchOptions *)
+ * Takes a command starting with "with", the number of arguments, and the options to fill in as inputs
+ * Returns the number of words the prefix used, or -1 if it is wrong
+ * Reads "with [--cpus list] [--nice n] [--rlimit name=value[,name=value]] [--io-class class[:level]] [--] command"
+ */
+int parseLaunchOptions(char *command[], int numArguments, struct launchOptions *options){
+	memset(options, 0, sizeof(struct launchOptions));
+	int i = 1;
+	while(i < numArguments && strncmp(command[i], "--", 2) == 0){
+		char *option = command[i];
+		if(strcmp(option, "--") == 0){//everything after this is the command
+			i++;
+			break;
+		}
+		if(i + 1 == numArguments){
+			printf("Error: missing value for \"%s\"\n",option);
+			fflush(stdout);
+			return -1;
+		}
+		char *value = command[i+1];
+		bool valid = true;
+		if(strcmp(option, "--cpus") == 0){
+			valid = parseCpuList(value, &options->cpus);
+			options->hasCpus = true;
+			describeOption(options, "cpus=", value, strlen(value));
+		}else if(strcmp(option, "--nice") == 0){
+			char *end;
+			long nice = strtol(value, &end, 10);
+			valid = end != value && *end == '\0' && nice >= -20 && nice <= 19;
+			options->nice = nice;
+			options->hasNice = true;
+			describeOption(options, "nice=", value, strlen(value));
+		}else if(strcmp(option, "--rlimit") == 0){
+			char *limit = value;
+			while(valid && *limit != '\0'){//a comma separated list of name=value
+				char *equals = strchr(limit, '=');
+				char *comma = strchr(limit, ',');
+				if(comma == NULL){
+					comma = limit + strlen(limit);
+				}
+				int resource = -1;
+				for(size_t n = 0; equals != NULL && equals < comma && n < sizeof(limitNames) / sizeof(limitNames[0]); n++){
+					if(strlen(limitNames[n].name) == (size_t)(equals - limit) && strncmp(limit, limitNames[n].name, equals - limit) == 0){
+						resource = limitNames[n].resource;
+					}
+				}
+				valid = resource != -1 && options->numLimits < LAUNCH_MAX_LIMITS;
+				if(valid){
+					char saved = *comma;
+					*comma = '\0';//end the value in place so it can be read
+					valid = parseLimitValue(equals + 1, &options->limitValues[options->numLimits]);
+					*comma = saved;
+				}
+				if(valid){
+					options->limitResources[options->numLimits] = resource;
+					options->numLimits++;
+					describeOption(options, "", limit, comma - limit);
+				}
+				limit = *comma == ',' ? comma + 1 : comma;
+			}
+		}else if(strcmp(option, "--io-class") == 0){
+			char *colon = strchr(value, ':');
+			size_t nameLength = colon == NULL ? strlen(value) : (size_t)(colon - value);
+			int level = 4;//the default level within a class
+			if(colon != NULL){
+				char *end;
+				level = strtol(colon + 1, &end, 10);
+				valid = end != colon + 1 && *end == '\0' && level >= 0 && level <= 7;
+			}
+			int ioClass = 0;
+			if(nameLength == 8 && strncmp(value, "realtime", 8) == 0){
+				ioClass = IOPRIO_CLASS_RT;
+			}else if(nameLength == 11 && strncmp(value, "best-effort", 11) == 0){
+				ioClass = IOPRIO_CLASS_BE;
+			}else if(nameLength == 4 && strncmp(value, "idle", 4) == 0){
+				ioClass = IOPRIO_CLASS_IDLE;
+				level = 0;//idle has no levels
+			}else{
+				valid = false;
+			}
+			options->ioPriority = ioClass << IOPRIO_CLASS_SHIFT | level;
+			options->hasIoClass = true;
+			describeOption(options, "io=", value, strlen(value));
+		}else{
+			printf("Error: unknown option \"%s\" for command \"with\"\n",option);
+			fflush(stdout);
+			return -1;
+		}
+		if(valid == false){
+			printf("Error: bad value \"%s\" for \"%s\"\n",value,option);
+			fflush(stdout);
+			return -1;
+		}
+		i += 2;
+	}
+	if(i == numArguments){
+		printf("Usage: with [--cpus list] [--nice n] [--rlimit name=value,...] [--io-class class[:level]] command\n");
+		fflush(stdout);
+		return -1;
+	}
+	return i;
+}
+
+/* applyLaunchOptions(struct launchOptions *)
+ * Takes the launch options for a command as input
+ * Returns false if one of them couldn't be applied, after printing which one
+ * Runs in the child before exec, so only the command and anything it starts are limited
+ */
+bool applyLaunchOptions(struct launchOptions *options){
+	if(options->hasCpus && sched_setaffinity(0, sizeof(cpu_set_t), &options->cpus) == -1){
+		printf("Error: unable to set the CPUs to run on\n");
+		return false;
+	}
+	if(options->hasNice && setpriority(PRIO_PROCESS, 0, options->nice) == -1){
+		printf("Error: unable to set the niceness to %d\n",options->nice);
+		return false;
+	}
+	for(int i = 0; i < options->numLimits; i++){
+		struct rlimit limit = {options->limitValues[i], options->limitValues[i]};
+		if(setrlimit(options->limitResources[i], &limit) == -1){
+			printf("Error: unable to set a resource limit\n");
+			return false;
+		}
+	}
+	if(options->hasIoClass && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, options->ioPriority) == -1){//glibc has no wrapper for ioprio_set
+		printf("Error: unable to set the I/O class\n");
+		return false;
+	}
+	return true;
+}
+
+/* hasSpecialRedirection(struct stage *)
+ * Takes a pipeline stage as input
+ * Returns true if the stage redirects to or from something that already exists and isn't a regular file, like a FIFO or a device.
+ * Opening one of those can block until something opens the other end, so it has to happen in the child and not in the shell
+ */
+bool hasSpecialRedirection(struct stage *stage){
+	struct stat fileInfo;
+	if(stage->inputFile != NULL && stat(stage->inputFile, &fileInfo) == 0 && S_ISREG(fileInfo.st_mode) == false){
+		return true;
+	}
+	return stage->outputFile != NULL && stat(stage->outputFile, &fileInfo) == 0 && S_ISREG(fileInfo.st_mode) == false;
+}
+
+/* struct execCheck
+ * The error pipe of a forked child that the shell didn't wait to exec, looked at again later
+ */
+struct execCheck{
+	int fd;//read end of the child's error pipe, non-blocking
+	char *name;//the command, to drop from the PATH cache if its cached path failed
+};
+
+struct execCheck *execChecks = NULL;//error pipes of background children and children opening their own redirections
+int numExecChecks = 0;
+int execCheckCapacity = 0;
+
+/* checkExecErrors()
+ * Takes no inputs
+ * Returns nothing
+ * Looks at every error pipe that is waiting without blocking. A pipe that has closed means the exec worked, an errno in it means
+ * the cached path failed and the command is dropped from the PATH cache. Pipes whose child hasn't got to exec yet are kept
+ */
+void checkExecErrors(){
+	int numKept = 0;
+	for(int i = 0; i < numExecChecks; i++){
+		int error;
+		ssize_t result = read(execChecks[i].fd, &error, sizeof(error));
+		if(result == -1 && (errno == EAGAIN || errno == EINTR)){//still waiting on the child
+			execChecks[numKept] = execChecks[i];
+			numKept++;
+			continue;
+		}
+		if(result == sizeof(error) && (error == ENOENT || error == EACCES)){//the command moved since it was cached
+			forgetCommand(execChecks[i].name);
+		}
+		close(execChecks[i].fd);
+		free(execChecks[i].name);
+	}
+	numExecChecks = numKept;
+}
+
+/* launchWithFork(struct stage *, bool, pid_t, struct launchOptions *)
+ * Takes a pipeline stage, if the command is a background process, the process group to put it in (0 for a new one, -1 to stay in the shell's),
+ * and the launch options from the with prefix (NULL if there weren't any)
+ * Returns the pid of the child, or -1 if no child was started
+ * Original launch path, used when posix_spawn can't be, like when there are launch options to apply. The child sets up redirection,
+ * signals and limits itself before exec
+ */
+pid_t launchWithFork(struct stage *stage, bool thisIsBackground, pid_t processGroup, struct launchOptions *options){
+	char **command = stage->command;
+	char *inputFile = stage->inputFile;
+	char *outputFile = stage->outputFile;
+	char *commandPath = findCommand(command[0]);//look the command up in the shell so the result stays cached for next time
+	int errorPipe[2] = {-1, -1};//the child writes errno here if the cached path fails, the pipe closes on exec so a working exec says nothing
+	if(commandPath != NULL && commandPath != command[0] && pipe2(errorPipe, O_CLOEXEC) == -1){
+		errorPipe[0] = -1;
+		errorPipe[1] = -1;
+	}
+	pid_t spawnPid = fork();//create fork
+	if(spawnPid == -1){//if the fork failed, print an error
+		printf("Error creating child process\n");
+		fflush(stdout);
+		stage->launchError = 1;
+	}else if(spawnPid == 0){
+		//This is the child process
+		if(DEBUG){
+			printf("Child pid: %d, Running command %s\n",getpid(),command[0]);
+			fflush(stdout);
+		}
+		sigset_t childMask;//the shell blocks SIGCHLD while launching, and parallel blocks SIGINT too, the command shouldn't inherit that
+		sigemptyset(&childMask);
+		sigaddset(&childMask, SIGCHLD);
+		sigaddset(&childMask, SIGINT);
+		sigprocmask(SIG_UNBLOCK, &childMask, NULL);
+		if(processGroup != -1){//join the pipeline's process group
+			setpgid(0, processGroup);
+		}
+
+		//connect the pipes to the stages before and after this one, any file redirection below replaces them
+		if(stage->inFd != -1){
+			dup2(stage->inFd, 0);
+		}
+		if(stage->outFd != -1){
+			dup2(stage->outFd, 1);
+		}
+
+		if(outputFile != NULL){
+			//redirect output
+			int outFile = open(outputFile,O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);//open the file for writing only
+
+			if(outFile == -1){//if the file doesn't open, print an error and exit
+				printf("Error opening file \"%s\"\n",outputFile);
+				fflush(stdout);
+				exit(1);
+			}
+			int result = dup2(outFile,1);//run dup2 to redirect the output to the new file
+			if(result == -1){//if there is a problem redirecting, print an error and exit
+				printf("Error redirecting output\n");
+				fflush(stdout);
+				exit(2);
+			}
+		}
+		if(inputFile != NULL){
+			//redirect input
+			int inFile = open(inputFile,O_RDONLY, S_IRUSR | S_IWUSR);//open the input file for reasing only
+			
+			if(inFile == -1){//if the file doesn't open, print an error and exit
+				printf("Error opening file \"%s\"\n",inputFile);
+				fflush(stdout);
+				exit(1);
+			}
+
+			int result = dup2(inFile, 0);//run dup2 to redirect the input to the new file
+			if(result == -1){//if there is a problem redirecting, print an error and exit
+				printf("Error redirecting input\n");
+				fflush(stdout);
+				exit(2);
+			}
+		}
+
+		//Set signal handlers for this child process
+		struct sigaction ignore_action = {{0}};
+		ignore_action.sa_handler = SIG_IGN;//create ignore action
+		if(thisIsBackground){//Check if this child is a background process, the signals need to be handled different if they are
+			sigaction(SIGTSTP,&ignore_action,NULL);//ignore SIGTSTP(Ctrl+z) and SIGINT(Ctrl+c) if in a background process
+			sigaction(SIGINT,&ignore_action,NULL);
+
+			//if the input and output haven't been redirected, redirect them to dev/null/
+
+			if(inputFile == NULL && stage->inFd == -1){//if input wasn't redirected or piped
+				int devNull = open("/dev/null",O_RDONLY);//open /dev/null for reading only
+				if(devNull == -1){//If there is an error opening /dev/null, print an error and exit
+					printf("Error opening file \"/dev/null\"\n");
+					fflush(stdout);
+					exit(1);
+				}
+				int result = dup2(devNull, 0);//redirect input to /dev/null
+				if(result == -1){//if there is an error redirecting input, print an error and exit
+					printf("Error redirecting input\n");
+					fflush(stdout);
+					exit(2);
+				}	
+			}
+			
+			if(outputFile == NULL && stage->outFd == -1){//if output wan't redirected or piped
+				int devNull = open("/dev/null",O_WRONLY);//open /dev/null for writing only
+				if(devNull == -1){//If there is an error opening /dev/null, print an error and exit
+					printf("Error opening file \"/dev/null\"\n");
+					fflush(stdout);
+					exit(1);
+				}
+				int result = dup2(devNull, 1);//redirect output to /dev/null
+				if(result == -1){//If there is an error redirecting output, print an error and exit
+					printf("Errpr redirecting output\n");
+					fflush(stdout);
+					exit(2);
+				}
+
+			}
+
+		}else{
+			//if not in a background process
+			struct sigaction SIGINT_action = {{0}};//create SIGINT(Ctrl+c) struct
+
+			SIGINT_action.sa_handler = handle_SIGINT;//set the function to the handle_SIGINT function
+			sigfillset(&SIGINT_action.sa_mask);//fill the struct
+			SIGINT_action.sa_flags = 0;
+			sigaction(SIGINT,&SIGINT_action,NULL);
+
+			//Set ignore mask to prevent process fro exiting if (Ctrl+z) signal is recieved
+			//https://edstem.org/us/courses/6837/discussion/535386
+			sigset_t mask;
+			sigfillset(&mask);
+			sigdelset(&mask,SIGBUS);
+			sigdelset(&mask,SIGFPE);
+			sigdelset(&mask,SIGILL);
+			sigdelset(&mask,SIGSEGV);
+
+			ignore_action.sa_mask = mask;
+			sigaction(SIGTSTP,&ignore_action,NULL);//ignore SIGTSTP(Ctrl+z)
+		}
+		
+		if(jobControl && processGroup != -1){//a job in its own group can be stopped with Ctrl+z, and fg and bg start it again
+			if(thisIsBackground == false){
+				tcsetpgrp(terminalFd, getpgrp());//SIGTTOU is still ignored from the shell, so taking the terminal can't stop the child
+			}
+			struct sigaction default_action = {{0}};
+			default_action.sa_handler = SIG_DFL;
+			sigaction(SIGINT, &default_action, NULL);//a background job only gets ^C once fg gives it the terminal
+			sigaction(SIGTSTP, &default_action, NULL);
+			sigaction(SIGTTIN, &default_action, NULL);
+			sigaction(SIGTTOU, &default_action, NULL);
+		}
+
+		if(options != NULL && applyLaunchOptions(options) == false){
+			fflush(stdout);
+			exit(1);
+		}
+
+		if(command[0] != NULL){//as long as there are more than 0 arguments
+			if(commandPath != NULL){
+				execve(commandPath,command,environment.variables);//run the path the shell found, with the shell's environment
+				if(errorPipe[1] != -1){//tell the shell, so it drops the cached path
+					int error = errno;
+					write(errorPipe[1], &error, sizeof(error));
+				}
+			}
+			execvp(command[0],command);//if that didn't work the cached path may be stale, so let execvp search PATH again, environ is the same table
+			//perror("exec()\n");//exec will only run anything past the function call if it failed, so print an error and exit
+			//fflush(stdout);
+		}
+		exit(2);
+	}else if(processGroup != -1){//set the process group from the shell too, so it is in place before the next stage tries to join it
+		setpgid(spawnPid, processGroup == 0 ? spawnPid : processGroup);
+	}
+	if(errorPipe[0] != -1 && (thisIsBackground || hasSpecialRedirection(stage))){//the child could take a long time to get to exec, so check on it later
+		close(errorPipe[1]);
+		char *name = strdup(command[0]);
+		if(numExecChecks >= execCheckCapacity){
+			int newCapacity = execCheckCapacity == 0 ? 16 : execCheckCapacity * 2;
+			struct execCheck *newChecks = realloc(execChecks, newCapacity * sizeof(struct execCheck));
+			if(newChecks != NULL){
+				execChecks = newChecks;
+				execCheckCapacity = newCapacity;
+			}
+		}
+		if(name == NULL || numExecChecks >= execCheckCapacity){//without memory the stale entry is just found again next time
+			free(name);
+			close(errorPipe[0]);
+		}else{
+			fcntl(errorPipe[0], F_SETFL, O_NONBLOCK);
+			execChecks[numExecChecks].fd = errorPipe[0];
+			execChecks[numExecChecks].name = name;
+			numExecChecks++;
+		}
+	}else if(errorPipe[0] != -1){
+		close(errorPipe[1]);
+		int error;
+		ssize_t result;
+		do{
+			result = read(errorPipe[0], &error, sizeof(error));//returns once the child has execed or the cached path failed
+		}while(result == -1 && errno == EINTR);
+		close(errorPipe[0]);
+		if(result == sizeof(error) && (error == ENOENT || error == EACCES)){//the command moved since it was cached
+			forgetCommand(command[0]);
+		}
+	}
+	return spawnPid;
+}
+
+/* openStageFiles(struct stage *, bool, int *, int *)
+ * Takes a pipeline stage, if the command is a background process, and pointers to the input and output fds as inputs
+ * Returns false if a redirection couldn't be opened, after printing an error and setting the stage's launchError
+ * Opens the stage's redirections in the shell, close on exec, for the launch paths that hand fds to the child. Those paths only
+ * get here when the redirections are regular files or don't exist yet, anything else goes through fork. With no file
+ * redirection the fds are the pipes from the stages around it, and background processes with neither use /dev/null
+ */
+bool openStageFiles(struct stage *stage, bool thisIsBackground, int *inputFd, int *outputFd){
+	char *inputFile = stage->inputFile;
+	char *outputFile = stage->outputFile;
+	int inFile = -1;
+	int outFile = -1;
+	//if the input and output aren't redirected or piped, background processes use /dev/null instead
+	if(inputFile == NULL && stage->inFd == -1 && thisIsBackground){
+		inputFile = "/dev/null";
+	}
+	if(outputFile == NULL && stage->outFd == -1 && thisIsBackground){
+		outputFile = "/dev/null";
+	}
+	if(outputFile != NULL){
+		outFile = open(outputFile,O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);//open the file for writing only
+		if(outFile == -1){//if the file doesn't open, print an error
+			printf("Error opening file \"%s\"\n",outputFile);
+			fflush(stdout);
+			stage->launchError = 1;
+			return false;
+		}
+	}
+	if(inputFile != NULL){
+		inFile = open(inputFile,O_RDONLY | O_CLOEXEC);//open the input file for reading only
+		if(inFile == -1){//if the file doesn't open, print an error
+			printf("Error opening file \"%s\"\n",inputFile);
+			fflush(stdout);
+			if(outFile != -1){
+				close(outFile);
+			}
+			stage->launchError = 1;
+			return false;
+		}
+	}
+	if(inFile == -1){//with no file redirection, use the pipe from the stage before if there is one
+		inFile = stage->inFd;
+	}
+	if(outFile == -1){
+		outFile = stage->outFd;
+	}
+	*inputFd = inFile;
+	*outputFd = outFile;
+	return true;
+}
+
+/* closeStageFiles(struct stage *, int, int)
+ * Takes a pipeline stage and the fds openStageFiles gave it as inputs
+ * Returns nothing
+ * Closes the fds once the child has its own copies. The pipe ends are left for the code running the pipeline to close
+ */
+void closeStageFiles(struct stage *stage, int inFile, int outFile){
+	if(inFile != -1 && inFile != stage->inFd){
+		close(inFile);
+	}
+	if(outFile != -1 && outFile != stage->outFd){
+		close(outFile);
+	}
+}
+
+/* launchWithSpawn(struct stage *, bool, pid_t)
+ * Takes a pipeline stage, if the command is a background process, and the process group to put it in (0 for a new one, -1 to stay in the shell's)
+ * Returns the pid of the child, or -1 if no child was started
+ * Launches the command with posix_spawn, which doesn't copy the shell's page tables the way fork does.
+ * The command is looked up with the PATH cache, and if a cached path fails it is dropped and looked up once more.
+ * The redirections are opened here in the shell and handed to the child as file actions, and the signal setup is done with spawn attributes:
+ * SIGINT goes back to its default in foreground processes and stays ignored in background ones, unless the job has its own process
+ * group under job control, where the terminal decides who gets ^C. SIGTSTP is ignored in both,
+ * unless the job has its own process group under job control. posix_spawn can only reset handled signals to the default, so the
+ * shell ignores SIGTSTP itself for the moment it takes to spawn, and the child inherits that. A blocked mask would be inherited by
+ * everything the command starts too
+ */
+pid_t launchWithSpawn(struct stage *stage, bool thisIsBackground, pid_t processGroup){
+	char **command = stage->command;
+	if(hasSpecialRedirection(stage)){//a FIFO or device could block the shell if it opened it, so the child opens it after fork
+		return launchWithFork(stage, thisIsBackground, processGroup, NULL);
+	}
+
+	int inFile;
+	int outFile;
+	if(openStageFiles(stage, thisIsBackground, &inFile, &outFile) == false){
+		return -1;
+	}
+
+	posix_spawn_file_actions_t fileActions;
+	posix_spawn_file_actions_init(&fileActions);
+	if(inFile != -1){//every fd the shell opens is close on exec and dup2 clears that, so only the copies on 0 and 1 make it to the child
+		posix_spawn_file_actions_adddup2(&fileActions, inFile, 0);
+	}
+	if(outFile != -1){
+		posix_spawn_file_actions_adddup2(&fileActions, outFile, 1);
+	}
+
+	posix_spawnattr_t attributes;
+	posix_spawnattr_init(&attributes);
+	short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+	sigset_t defaultSignals;
+	sigemptyset(&defaultSignals);
+	bool jobSignals = jobControl && processGroup != -1;//a job in its own group can be stopped with Ctrl+z, and fg and bg start it again
+	if(thisIsBackground == false || jobSignals){//the shell ignores SIGINT, so foreground processes, and jobs fg can bring forward, get the default back
+		sigaddset(&defaultSignals, SIGINT);
+	}
+	if(jobSignals){
+		sigaddset(&defaultSignals, SIGTSTP);
+		sigaddset(&defaultSignals, SIGTTIN);
+		sigaddset(&defaultSignals, SIGTTOU);
+	}
+	posix_spawnattr_setsigdefault(&attributes, &defaultSignals);
+	sigset_t blockedSignals;
+	sigemptyset(&blockedSignals);
+	posix_spawnattr_setsigmask(&attributes, &blockedSignals);
+#ifdef __GLIBC_PREREQ
+#if __GLIBC_PREREQ(2, 35)
+	if(jobSignals && thisIsBackground == false){//take the terminal in the child, before the command can try to read from it
+		posix_spawn_file_actions_addtcsetpgrp_np(&fileActions, terminalFd);
+	}
+#endif
+#endif
+	if(processGroup != -1){//join the pipeline's process group
+		posix_spawnattr_setpgroup(&attributes, processGroup);
+		flags |= POSIX_SPAWN_SETPGROUP;
+	}
+	posix_spawnattr_setflags(&attributes, flags);
+
+	struct sigaction shellTstpAction;
+	if(jobSignals == false){//SIGTSTP(Ctrl+z) is ignored in the child so it never stops it, the same as the fork path
+		struct sigaction ignore_action = {{0}};
+		ignore_action.sa_handler = SIG_IGN;
+		sigaction(SIGTSTP, &ignore_action, &shellTstpAction);
+	}
+	pid_t spawnPid;
+	int result = ENOENT;
+	char *commandPath = findCommand(command[0]);
+	if(commandPath != NULL){
+		result = posix_spawn(&spawnPid, commandPath, &fileActions, &attributes, command, environment.variables);
+		if((result == ENOENT || result == EACCES) && commandPath != command[0]){//the command moved since it was cached
+			forgetCommand(command[0]);
+			commandPath = findCommand(command[0]);
+			if(commandPath != NULL){
+				result = posix_spawn(&spawnPid, commandPath, &fileActions, &attributes, command, environment.variables);
+			}
+		}
+	}
+	if(jobSignals == false){
+		sigaction(SIGTSTP, &shellTstpAction, NULL);
+	}
+
+	posix_spawnattr_destroy(&attributes);
+	posix_spawn_file_actions_destroy(&fileActions);
+	closeStageFiles(stage, inFile, outFile);
+
+	if(result != 0){//the command couldn't be run, which the fork path reports as an exit value of 2
+		if(DEBUG){
+			printf("posix_spawn failed: %s\n",strerror(result));
+			fflush(stdout);
+		}
+		stage->launchError = 2;
+		return -1;
+	}
+	if(DEBUG){
+		printf("Child pid: %d, Running command %s\n",spawnPid,command[0]);
+		fflush(stdout);
+	}
+	return spawnPid;
+}
+
+/* struct zygoteRequest
+ * The fixed part of a launch request sent to the zygote. The strings follow it in the same message, and the fds for
+ * stdin and stdout come with it as SCM_RIGHTS
+ */
+struct zygoteRequest{
+	bool background;//if the command is a background process
+	pid_t processGroup;//-1 stays in the shell's group, 0 starts a new one, anything else is joined
+	int numArguments;
+	int numEnvironment;//-1 if the environment hasn't changed since the last request, so the zygote keeps the one it has
+	bool hasInput;//if a fd for stdin came with the request
+	bool hasOutput;//if a fd for stdout came with the request, it is after the stdin one
+	size_t length;//bytes of strings after the header: the path, the arguments, the directory, then any environment, each null terminated
+};
+
+/* struct zygoteReply
+ * The zygote's answer to a launch request
+ */
+struct zygoteReply{
+	pid_t pid;//the new process, or -1 if it couldn't be made
+	int error;//errno from clone or exec, 0 if the command is running
+};
+
+int zygoteFd = -1;//the shell's end of the socket to the zygote, -1 if there isn't one
+unsigned long zygoteGeneration = 0;//the environment generation the zygote has, it is only sent again once it changes
+char zygoteBuffer[ZYGOTE_REQUEST_SIZE];//where requests are packed in the shell and unpacked in the zygote
+
+/* struct zygoteLaunch
+ * Everything the zygote's child needs to start a command. The child shares the zygote's memory until it execs,
+ * so it reads this in place and writes error back into it
+ */
+struct zygoteLaunch{
+	struct zygoteRequest *request;
+	char *path;
+	char **arguments;
+	char **environment;
+	char *directory;
+	int inFd;
+	int outFd;
+	int error;//errno if the exec failed, 0 if it worked
+};
+
+/* zygoteChild(void *)
+ * Takes the zygote launch as input
+ * Returns only if the command couldn't be run
+ * Runs in the new process before exec. It sets up the process group, signals and fds the same way the other launch paths do.
+ * The zygote has no signal handlers, so nothing else can run on the shared memory while this does
+ */
+int zygoteChild(void *argument){
+	struct zygoteLaunch *launch = argument;
+	struct sigaction default_action = {{0}};
+	default_action.sa_handler = SIG_DFL;
+	if(launch->request->processGroup != -1){
+		setpgid(0, launch->request->processGroup);
+	}
+	if(launch->request->background == false || (jobControl && launch->request->processGroup != -1)){//foreground processes and jobs fg can bring forward get SIGINT back
+		sigaction(SIGINT, &default_action, NULL);
+	}
+	sigset_t blockedSignals;
+	sigemptyset(&blockedSignals);
+	if(jobControl && launch->request->processGroup != -1){//a job in its own group can be stopped with Ctrl+z, and fg and bg start it again
+		if(launch->request->background == false){
+			tcsetpgrp(terminalFd, getpgrp());//SIGTTOU is still ignored from the shell, so taking the terminal can't stop the child
+		}
+		sigaction(SIGTSTP, &default_action, NULL);
+		sigaction(SIGTTIN, &default_action, NULL);
+		sigaction(SIGTTOU, &default_action, NULL);
+	}//otherwise SIGTSTP stays ignored from the zygote, so it never stops the child, the same as the other launch paths
+	sigprocmask(SIG_SETMASK, &blockedSignals, NULL);
+	if(launch->inFd != -1){
+		dup2(launch->inFd, 0);
+	}
+	if(launch->outFd != -1){
+		dup2(launch->outFd, 1);
+	}
+	if(chdir(launch->directory) == 0){
+		execve(launch->path, launch->arguments, launch->environment);
+	}
+	launch->error = errno;
+	_exit(127);
+}
+
+/* zygoteMain(int)
+ * Takes the zygote's end of the socket as input
+ * Never returns
+ * The loop the zygote runs. It waits for launch requests and starts each command with clone(CLONE_VM | CLONE_VFORK | CLONE_PARENT),
+ * so the child borrows the zygote's small memory instead of copying anything, and is the shell's child, so the shell reaps it.
+ * Like posix_spawn, the zygote only carries on once the exec has worked or failed. It exits once the shell closes the socket
+ */
+void zygoteMain(int socketFd){
+	struct sigaction ignore_action = {{0}}, default_action = {{0}};
+	ignore_action.sa_handler = SIG_IGN;
+	default_action.sa_handler = SIG_DFL;
+	sigaction(SIGTSTP, &ignore_action, NULL);//SIGINT is already ignored, and the zygote never has children of its own
+	sigaction(SIGCHLD, &default_action, NULL);
+	sigset_t noSignals;
+	sigemptyset(&noSignals);
+	sigprocmask(SIG_SETMASK, &noSignals, NULL);
+	static char childStack[ZYGOTE_STACK_SIZE];//the child runs on this until it execs
+	char **savedEnvironment = environment.variables;//the zygote starts with the shell's environment, and keeps each one it is sent
+	char *savedEnvironmentText = NULL;
+
+	while(true){
+		struct zygoteRequest request;
+		struct iovec parts[2] = {{&request, sizeof(request)}, {zygoteBuffer, sizeof(zygoteBuffer)}};
+		union{
+			struct cmsghdr header;
+			char space[CMSG_SPACE(2 * sizeof(int))];
+		} control;
+		struct msghdr message = {0};
+		message.msg_iov = parts;
+		message.msg_iovlen = 2;
+		message.msg_control = &control;
+		message.msg_controllen = sizeof(control);
+		ssize_t received = recvmsg(socketFd, &message, MSG_CMSG_CLOEXEC);
+		if(received == -1 && errno == EINTR){
+			continue;
+		}
+		if(received < (ssize_t)sizeof(request)){//the shell is gone
+			_exit(0);
+		}
+
+		int fds[2] = {-1, -1};
+		struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+		if(header != NULL && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS){
+			memcpy(fds, CMSG_DATA(header), header->cmsg_len - CMSG_LEN(0));
+		}
+		struct zygoteLaunch launch;
+		launch.request = &request;
+		launch.inFd = request.hasInput ? fds[0] : -1;
+		launch.outFd = request.hasOutput ? fds[request.hasInput ? 1 : 0] : -1;
+		launch.error = 0;
+		launch.arguments = malloc((request.numArguments + 1) * sizeof(char *));
+		launch.environment = savedEnvironment;
+
+		struct zygoteReply reply = {-1, 0};
+		if(launch.arguments == NULL){
+			reply.error = ENOMEM;
+		}else{
+			char *text = zygoteBuffer;
+			launch.path = text;
+			text += strlen(text) + 1;
+			for(int i = 0; i < request.numArguments; i++){
+				launch.arguments[i] = text;
+				text += strlen(text) + 1;
+			}
+			launch.arguments[request.numArguments] = NULL;
+			launch.directory = text;
+			text += strlen(text) + 1;
+			if(request.numEnvironment >= 0){//a new environment, copied out of the buffer so it lasts until the next one
+				size_t environmentLength = zygoteBuffer + request.length - text;
+				char **newEnvironment = malloc((request.numEnvironment + 1) * sizeof(char *));
+				char *newEnvironmentText = malloc(environmentLength + 1);
+				if(newEnvironment != NULL && newEnvironmentText != NULL){
+					memcpy(newEnvironmentText, text, environmentLength);
+					text = newEnvironmentText;
+					for(int i = 0; i < request.numEnvironment; i++){
+						newEnvironment[i] = text;
+						text += strlen(text) + 1;
+					}
+					newEnvironment[request.numEnvironment] = NULL;
+					if(savedEnvironmentText != NULL){//the first environment is the one copied from the shell, which isn't freed
+						free(savedEnvironment);
+						free(savedEnvironmentText);
+					}
+					savedEnvironment = newEnvironment;
+					savedEnvironmentText = newEnvironmentText;
+					launch.environment = newEnvironment;
+				}else{//the shell sends it again if the launch fails
+					free(newEnvironment);
+					free(newEnvironmentText);
+					reply.error = ENOMEM;
+				}
+			}
+
+			if(reply.error == 0){
+				pid_t pid = clone(zygoteChild, childStack + sizeof(childStack), CLONE_VM | CLONE_VFORK | CLONE_PARENT | SIGCHLD, &launch);
+				if(pid == -1){
+					reply.error = errno;
+				}else if(launch.error != 0){//exec failed, the child has already exited
+					reply.error = launch.error;
+				}else{
+					reply.pid = pid;
+				}
+			}
+		}
+		free(launch.arguments);
+		if(launch.inFd != -1){
+			close(launch.inFd);
+		}
+		if(launch.outFd != -1){
+			close(launch.outFd);
+		}
+		send(socketFd, &reply, sizeof(reply), MSG_NOSIGNAL);
+	}
+}
+
+/* startZygote()
+ * Takes no inputs
+ * Returns nothing
+ * Forks the zygote and keeps the shell's end of the socket to it. If it can't be started, commands are launched with posix_spawn
+ */
+void startZygote(){
+	int fds[2];
+	if(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) == -1){
+		launchBackend = LAUNCH_SPAWN;
+		return;
+	}
+	pid_t pid = fork();
+	if(pid == 0){
+		close(fds[0]);
+		zygoteMain(fds[1]);
+	}
+	close(fds[1]);
+	if(pid == -1){
+		close(fds[0]);
+		launchBackend = LAUNCH_SPAWN;
+		return;
+	}
+	zygoteFd = fds[0];
+	zygoteGeneration = environment.generation;//the zygote was forked with the shell's environment
+}
+
+/* packString(size_t *, char *)
+ * Takes how much of the zygote buffer is used and a string as inputs
+ * Returns false if the string doesn't fit
+ * Adds the string, with its null terminator, to the end of the request being built in the zygote buffer
+ */
+bool packString(size_t *length, char *text){
+	size_t textLength = strlen(text) + 1;
+	if(*length + textLength > sizeof(zygoteBuffer)){
+		return false;
+	}
+	memcpy(zygoteBuffer + *length, text, textLength);
+	*length += textLength;
+	return true;
+}
+
+/* launchWithZygote(struct stage *, bool, pid_t)
+ * Takes a pipeline stage, if the command is a background process, and the process group to put it in (0 for a new one, -1 to stay in the shell's)
+ * Returns the pid of the child, or -1 if no child was started
+ * Sends the command, the current directory, the environment if it changed since the last request, and the redirected fds to the
+ * zygote, which starts the command and sends back its pid. Anything the zygote can't take (a request too big for one message, a zygote that died, a stale cached path) goes
+ * through posix_spawn instead
+ */
+pid_t launchWithZygote(struct stage *stage, bool thisIsBackground, pid_t processGroup){
+	char **command = stage->command;
+	if(hasSpecialRedirection(stage)){//the same as posix_spawn, only regular files are opened in the shell
+		return launchWithFork(stage, thisIsBackground, processGroup, NULL);
+	}
+	char *commandPath = findCommand(command[0]);
+	if(commandPath == NULL){//the same as exec failing on the other launch paths
+		stage->launchError = 2;
+		return -1;
+	}
+
+	struct zygoteRequest request = {0};
+	request.background = thisIsBackground;
+	request.processGroup = processGroup;
+	request.numArguments = stage->numArguments;
+	bool fits = environment.directory != NULL && packString(&request.length, commandPath);
+	for(int i = 0; fits && i < stage->numArguments; i++){
+		fits = packString(&request.length, command[i]);
+	}
+	fits = fits && packString(&request.length, environment.directory);
+	bool sendEnvironment = zygoteGeneration != environment.generation;
+	request.numEnvironment = sendEnvironment ? environment.numVariables : -1;
+	for(int i = 0; fits && sendEnvironment && i < environment.numVariables; i++){
+		fits = packString(&request.length, environment.variables[i]);
+	}
+	if(fits == false){
+		return launchWithSpawn(stage, thisIsBackground, processGroup);
+	}
+
+	int inFile;
+	int outFile;
+	if(openStageFiles(stage, thisIsBackground, &inFile, &outFile) == false){
+		return -1;
+	}
+	int fds[2];
+	int numFds = 0;
+	if(inFile != -1){
+		request.hasInput = true;
+		fds[numFds] = inFile;
+		numFds++;
+	}
+	if(outFile != -1){
+		request.hasOutput = true;
+		fds[numFds] = outFile;
+		numFds++;
+	}
+
+	struct iovec parts[2] = {{&request, sizeof(request)}, {zygoteBuffer, request.length}};
+	union{
+		struct cmsghdr header;
+		char space[CMSG_SPACE(2 * sizeof(int))];
+	} control;
+	struct msghdr message = {0};
+	message.msg_iov = parts;
+	message.msg_iovlen = 2;
+	if(numFds > 0){
+		message.msg_control = &control;
+		message.msg_controllen = CMSG_SPACE(numFds * sizeof(int));
+		struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+		header->cmsg_level = SOL_SOCKET;
+		header->cmsg_type = SCM_RIGHTS;
+		header->cmsg_len = CMSG_LEN(numFds * sizeof(int));
+		memcpy(CMSG_DATA(header), fds, numFds * sizeof(int));
+	}
+
+	struct zygoteReply reply;
+	ssize_t result = sendmsg(zygoteFd, &message, MSG_NOSIGNAL);
+	if(result != -1){
+		do{
+			result = recv(zygoteFd, &reply, sizeof(reply), 0);
+		}while(result == -1 && errno == EINTR);
+	}
+	closeStageFiles(stage, inFile, outFile);
+	if(result != sizeof(reply)){//the zygote is gone, so stop using it
+		close(zygoteFd);
+		zygoteFd = -1;
+		launchBackend = LAUNCH_SPAWN;
+		return launchWithSpawn(stage, thisIsBackground, processGroup);
+	}
+
+	if(reply.pid != -1 && sendEnvironment){//the zygote has kept this environment
+		zygoteGeneration = environment.generation;
+	}
+	if(reply.pid == -1){
+		if((reply.error == ENOENT || reply.error == EACCES) && commandPath != command[0]){//the command moved since it was cached
+			forgetCommand(command[0]);
+			return launchWithSpawn(stage, thisIsBackground, processGroup);
+		}
+		if(DEBUG){
+			printf("zygote launch failed: %s\n",strerror(reply.error));
+			fflush(stdout);
+		}
+		stage->launchError = 2;
+		return -1;
+	}
+	if(DEBUG){
+		printf("Child pid: %d, Running command %s\n",reply.pid,command[0]);
+		fflush(stdout);
+	}
+	return reply.pid;
+}
+
+/* enum jobState
+ * Where a job is in its life. Free slots sit on the job table's free list
+ */
+enum jobState{
+	JOB_FREE,
+	JOB_RUNNING,
+	JOB_STOPPED,//stopped by a signal, fg and bg start it again
+	JOB_DONE
+};
+
+/* struct job
+ * One command that the shell has started, kept in the job table until it is done and reported
+ */
+struct job{
+	int id;//job number shown to the user, this is always the job's slot in the table plus 1
+	enum jobState state;//if the job is running, done, or the slot is free
+	pid_t pid;//pid of the last process in the pipeline, its status is the job's status
+	pid_t processGroup;//process group every process in a background job is in, 0 for foreground jobs which stay in the shell's group
+	int numProcesses;//number of processes in the job that haven't finished yet
+	bool background;//if the job was started with "&"
+	int status;//status from waitpid for the last process once the job is done
+	char *commandText;//the command that was run, for reports
+	struct timespec startTime;//CLOCK_MONOTONIC time the job was started
+	struct timespec endTime;//CLOCK_MONOTONIC time the last process in the job was reaped
+	struct rusage usage;//resource usage of every process in the job added together
+	bool timed;//if the command was run with the time builtin, so its usage is reported when it is done
+	char *limits;//the launch options the job was started with, NULL if it didn't have any
+	int stopSignal;//the signal that stopped the job, while it is stopped
+	unsigned long sequence;//when the job was started, stopped, or sent to the background, the newest one is the current job for fg and bg
+	bool waited;//if the wait builtin is waiting on this background job, so it is left in the table for wait to report
+	int nextFree;//the next free slot after this one, when this slot is free
+};
+
+/* struct pidEntry
+ * One spot in the job table's pid hash. pid is 0 for an empty spot and -1 for a removed one
+ */
+struct pidEntry{
+	pid_t pid;
+	int slot;//slot of the job this pid belongs to
+};
+
+/* struct jobTable
+ * Every job the shell is waiting on. Jobs live in a growable slab with a free list, so adding and removing them is O(1),
+ * and an open addressing hash from pid to slot lets the SIGCHLD reports find their job in O(1)
+ */
+struct jobTable{
+	struct job *jobs;//slab of job records
+	int capacity;//number of slots in jobs
+	int freeHead;//first free slot, -1 if there are none
+	int numJobs;//number of slots in use
+	struct pidEntry *pids;//hash from pid to slot, the size is always a power of 2
+	int pidCapacity;//number of spots in pids
+	int pidUsed;//number of spots in pids that are in use or removed
+	int numPids;//number of spots in pids that are in use, a job can have one pid per pipeline stage
+	unsigned long nextSequence;//sequence number for the next job that is started or stopped
+};
+
+/* jobTableReserve(struct jobTable *)
+ * Takes a job table as input
+ * Returns the slot of a new job, or -1 if there is no memory for it
+ * Takes a slot off the free list, doubling the slab first if it is empty. This happens before anything is launched,
+ * so a job that can't be tracked never gets started
+ */
+int jobTableReserve(struct jobTable *jobTable){
+	if(jobTable->freeHead == -1){//no free slots, so grow the slab and put the new slots on the free list
+		int newCapacity = jobTable->capacity == 0 ? 16 : jobTable->capacity * 2;
+		struct job *newJobs = realloc(jobTable->jobs, newCapacity * sizeof(struct job));
+		if(newJobs == NULL){
+			return -1;
+		}
+		for(int i = newCapacity - 1; i >= jobTable->capacity; i--){//link the new slots in order so the lowest job numbers get used first
+			newJobs[i].state = JOB_FREE;
+			newJobs[i].nextFree = jobTable->freeHead;
+			jobTable->freeHead = i;
+		}
+		jobTable->jobs = newJobs;
+		jobTable->capacity = newCapacity;
+	}
+	int slot = jobTable->freeHead;
+	struct job *job = &jobTable->jobs[slot];
+	jobTable->freeHead = job->nextFree;
+	jobTable->numJobs++;
+
+	job->id = slot + 1;
+	job->state = JOB_RUNNING;
+	job->pid = -1;
+	job->processGroup = 0;
+	job->numProcesses = 0;
+	job->background = false;
+	job->status = 0;
+	job->commandText = NULL;
+	job->timed = false;
+	job->limits = NULL;
+	job->stopSignal = 0;
+	job->sequence = jobTable->nextSequence++;
+	job->waited = false;
+	memset(&job->usage, 0, sizeof(struct rusage));
+	clock_gettime(CLOCK_MONOTONIC, &job->startTime);
+	job->endTime = job->startTime;
+	return slot;
+}
+
+/* jobTableRelease(struct jobTable *, int)
+ * Takes a job table and a slot as inputs
+ * Returns nothing
+ * Frees the job's command text and puts the slot back on the free list
+ */
+void jobTableRelease(struct jobTable *jobTable, int slot){
+	struct job *job = &jobTable->jobs[slot];
+	free(job->commandText);
+	job->commandText = NULL;
+	free(job->limits);
+	job->limits = NULL;
+	job->state = JOB_FREE;
+	job->nextFree = jobTable->freeHead;
+	jobTable->freeHead = slot;
+	jobTable->numJobs--;
+}
+
+/* pidHash(pid_t, int)
+ * Takes a pid and the size of the hash as inputs
+ * Returns the spot in the hash to start looking for the pid
+ */
+int pidHash(pid_t pid, int pidCapacity){
+	return (int)(((unsigned int)pid * 2654435761u) & (unsigned int)(pidCapacity - 1));
+}
+
+/* jobTableAddPid(struct jobTable *, int, pid_t)
+ * Takes a job table, a slot, and a pid as inputs
+ * Returns nothing
+ * Records that the pid belongs to the job in the slot, growing the hash when it is three quarters full
+ */
+void jobTableAddPid(struct jobTable *jobTable, int slot, pid_t pid){
+	if((jobTable->pidUsed + 1) * 4 > jobTable->pidCapacity * 3){//rebuild the hash, which also clears out removed spots
+		int newCapacity = jobTable->pidCapacity == 0 ? 64 : jobTable->pidCapacity;
+		while((jobTable->numPids + 1) * 2 > newCapacity){//sized on the live pids, so the rebuilt hash is at most half full
+			newCapacity *= 2;
+		}
+		struct pidEntry *newPids = calloc(newCapacity, sizeof(struct pidEntry));
+		if(newPids == NULL){//if there is no memory left, the shell can't keep going
+			printf("Error: out of memory\n");
+			fflush(stdout);
+			exit(1);
+		}
+		int newUsed = 0;
+		for(int i = 0; i < jobTable->pidCapacity; i++){
+			if(jobTable->pids[i].pid > 0){
+				int spot = pidHash(jobTable->pids[i].pid, newCapacity);
+				int probes = 0;
+				while(newPids[spot].pid != 0){
+					spot = (spot + 1) & (newCapacity - 1);
+					probes++;
+					assert(probes < newCapacity);
+				}
+				newPids[spot] = jobTable->pids[i];
+				newUsed++;
+			}
+		}
+		free(jobTable->pids);
+		jobTable->pids = newPids;
+		jobTable->pidCapacity = newCapacity;
+		jobTable->pidUsed = newUsed;
+	}
+	int spot = pidHash(pid, jobTable->pidCapacity);
+	int probes = 0;
+	while(jobTable->pids[spot].pid != 0){
+		spot = (spot + 1) & (jobTable->pidCapacity - 1);
+		probes++;
+		assert(probes < jobTable->pidCapacity);//the hash is never let fill up, so there is always an empty spot
+	}
+	jobTable->pids[spot].pid = pid;
+	jobTable->pids[spot].slot = slot;
+	jobTable->pidUsed++;
+	jobTable->numPids++;
+}
+
+/* jobTableFindPid(struct jobTable *, pid_t)
+ * Takes a job table and a pid as inputs
+ * Returns the spot in the pid hash the pid is in, or -1 if the pid isn't in the table
+ */
+int jobTableFindPid(struct jobTable *jobTable, pid_t pid){
+	if(jobTable->pidCapacity == 0 || pid <= 0){
+		return -1;
+	}
+	int spot = pidHash(pid, jobTable->pidCapacity);
+	for(int probes = 0; probes < jobTable->pidCapacity && jobTable->pids[spot].pid != 0; probes++){//bounded so a full hash can't spin
+		if(jobTable->pids[spot].pid == pid){
+			return spot;
+		}
+		spot = (spot + 1) & (jobTable->pidCapacity - 1);
+	}
+	return -1;
+}
+
+/* jobTableTakePid(struct jobTable *, pid_t)
+ * Takes a job table and a pid as inputs
+ * Returns the slot of the job the pid belonged to, or -1 if the pid isn't in the table
+ * Removes the pid from the hash, leaving a marker so later pids in the same run can still be found
+ */
+int jobTableTakePid(struct jobTable *jobTable, pid_t pid){
+	int spot = jobTableFindPid(jobTable, pid);
+	if(spot == -1){
+		return -1;
+	}
+	jobTable->pids[spot].pid = -1;
+	jobTable->numPids--;
+	return jobTable->pids[spot].slot;
+}
+
+/* signalJob(struct jobTable *, int, int)
+ * Takes a job table, a slot, and a signal as inputs
+ * Returns nothing
+ * Sends the signal to every process in the job. Jobs with their own process group get it with one killpg,
+ * the others get it one pid at a time
+ */
+void signalJob(struct jobTable *jobTable, int slot, int signal){
+	if(jobTable->jobs[slot].processGroup > 0){
+		killpg(jobTable->jobs[slot].processGroup, signal);
+		return;
+	}
+	for(int i = 0; i < jobTable->pidCapacity; i++){
+		if(jobTable->pids[i].pid > 0 && jobTable->pids[i].slot == slot){
+			kill(jobTable->pids[i].pid, signal);
+		}
+	}
+}
+
+/* joinWords(char *[], int)
+ * Takes an array of strings and its length as inputs
+ * Returns a newly allocated string with the words separated by spaces, or NULL if there is no memory
+ */
+char *joinWords(char *words[], int numWords){
+	size_t length = 1;
+	for(int i = 0; i < numWords; i++){
+		length += strlen(words[i]) + 1;
+	}
+	char *text = malloc(length);
+	if(text == NULL){
+		return NULL;
+	}
+	char *end = text;
+	for(int i = 0; i < numWords; i++){
+		if(i > 0){
+			*end = ' ';
+			end++;
+		}
+		size_t wordLength = strlen(words[i]);
+		memcpy(end, words[i], wordLength);
+		end += wordLength;
+	}
+	*end = '\0';
+	return text;
+}
+
+/* addUsage(struct rusage *, struct rusage *)
+ * Takes a running total and the resource usage of one process as inputs
+ * Returns nothing
+ * Adds the process's CPU time and context switches to the total, and keeps the largest max RSS
+ */
+void addUsage(struct rusage *total, struct rusage *usage){
+	timeradd(&total->ru_utime, &usage->ru_utime, &total->ru_utime);
+	timeradd(&total->ru_stime, &usage->ru_stime, &total->ru_stime);
+	if(usage->ru_maxrss > total->ru_maxrss){
+		total->ru_maxrss = usage->ru_maxrss;
+	}
+	total->ru_nvcsw += usage->ru_nvcsw;
+	total->ru_nivcsw += usage->ru_nivcsw;
+}
+
+/* printTimes(struct timespec *, struct timespec *, struct rusage *)
+ * Takes the CLOCK_MONOTONIC start and end times of a command and its resource usage as inputs
+ * Returns nothing
+ * Prints the report for the time builtin
+ */
+void printTimes(struct timespec *start, struct timespec *end, struct rusage *usage){
+	long long wallNanoseconds = (end->tv_sec - start->tv_sec) * 1000000000LL + (end->tv_nsec - start->tv_nsec);
+	printf("real\t%lld.%06llds\n",wallNanoseconds / 1000000000LL,(wallNanoseconds % 1000000000LL) / 1000);
+	printf("user\t%ld.%06lds\n",(long)usage->ru_utime.tv_sec,(long)usage->ru_utime.tv_usec);
+	printf("sys\t%ld.%06lds\n",(long)usage->ru_stime.tv_sec,(long)usage->ru_stime.tv_usec);
+	printf("maxrss\t%ld KB\n",usage->ru_maxrss);
+	printf("ctxsw\t%ld voluntary, %ld involuntary\n",usage->ru_nvcsw,usage->ru_nivcsw);
+	fflush(stdout);
+}
+
+/* collectChildren(struct jobTable *)
+ * Takes the job table as input
+ * Returns nothing
+ * Goes through the children the SIGCHLD handler has reaped, and marks a job as done once every process in it has finished.
+ * Background jobs are reported and their slots freed right away, foreground jobs are left for the code waiting on them.
+ * SIGCHLD has to be blocked while this runs
+ */
+void collectChildren(struct jobTable *jobTable){
+	if(numExecChecks > 0){//background children that have been reaped have execed or failed by now
+		checkExecErrors();
+	}
+	reapChildren();//pick up anything the handler had to leave behind because the queue was full
+	while(reapHead != reapTail){
+		struct reapedChild child = reapQueue[reapHead];
+		reapHead = (reapHead + 1) % REAP_QUEUE_SIZE;
+		if(reapHead == reapTail){//if the queue is empty, check for any children left over from a full queue
+			reapChildren();
+		}
+
+		traceEvent(TRACE_REAP, child.pid, child.status, &child.reapTime);
+		if(WIFSTOPPED(child.status) || WIFCONTINUED(child.status)){//the child is still around, so it stays in the pid hash
+			int spot = jobTableFindPid(jobTable, child.pid);
+			if(spot == -1){
+				continue;
+			}
+			struct job *job = &jobTable->jobs[jobTable->pids[spot].slot];
+			if(WIFSTOPPED(child.status) && job->state == JOB_RUNNING){//one stopped process is enough to call the job stopped
+				job->state = JOB_STOPPED;
+				job->stopSignal = WSTOPSIG(child.status);
+				job->sequence = jobTable->nextSequence++;
+				if(job->background){
+					printf("[%d] Stopped\t%s\n",job->id,job->commandText);
+					fflush(stdout);
+				}
+			}else if(WIFCONTINUED(child.status) && job->state == JOB_STOPPED){//someone else sent SIGCONT
+				job->state = JOB_RUNNING;
+			}
+			continue;
+		}
+		int slot = jobTableTakePid(jobTable, child.pid);
+		if(slot == -1){//not a child the shell is keeping track of
+			continue;
+		}
+		struct job *job = &jobTable->jobs[slot];
+		if(child.pid == job->pid){//the exit status of a pipeline comes from its last stage
+			job->status = child.status;
+		}
+		addUsage(&job->usage, &child.usage);
+		job->endTime = child.reapTime;
+		job->numProcesses--;
+		if(job->numProcesses > 0){//the rest of the pipeline is still running
+			continue;
+		}
+		job->state = JOB_DONE;
+		if(job->background){
+			pid_t reportPid = job->pid != -1 ? job->pid : job->processGroup;//if the last stage never started, report the pipeline by its process group
+			if(WIFEXITED(job->status)){
+				printf("background pid %i is done: exit value %i\n",reportPid, WEXITSTATUS(job->status));
+			}else{
+				printf("background pid %i is done: terminated by signal %i\n",reportPid, WTERMSIG(job->status));
+			}
+			fflush(stdout);
+			if(job->timed){
+				printTimes(&job->startTime, &job->endTime, &job->usage);
+			}
+			if(job->waited == false){//the wait builtin releases the jobs it is waiting on once it has their status
+				jobTableRelease(jobTable, slot);
+			}
+		}
+	}
+}
+
+/* launchJob(struct jobTable *, struct stage [], int, bool, bool, char *, struct launchOptions *)
+ * Takes the job table, the stages of a pipeline, the number of stages, if it is a background job, if it should be given the terminal,
+ * the text of the command, and the launch options for every stage (NULL if there aren't any)
+ * Returns the slot of the new job, or -1 if there wasn't room to track it
+ * Adds a job to the table and starts every stage, connecting each one to the next with a pipe. The shell never touches the
+ * data going through the pipes. Background pipelines and pipelines given the terminal get their own process group, so one
+ * killpg reaches the whole pipeline. Other foreground ones stay in the shell's group so they keep getting Ctrl+c from the terminal.
+ * SIGCHLD has to be blocked while this runs
+ */
+int launchJob(struct jobTable *jobTable, struct stage stages[], int numStages, bool thisIsBackground, bool takeTerminal, char *commandText, struct launchOptions *options){
+	int slot = jobTableReserve(jobTable);//make room in the job table before starting anything
+	if(slot == -1){
+		printf("Error: not enough memory to start another process.\n");
+		fflush(stdout);
+		free(commandText);
+		return -1;
+	}
+	jobTable->jobs[slot].commandText = commandText;
+	jobTable->jobs[slot].background = thisIsBackground;
+	if(options != NULL){
+		jobTable->jobs[slot].limits = strdup(options->description);
+	}
+	bool useFork = launchBackend == LAUNCH_FORK || options != NULL;//posix_spawn can't apply the launch options
+
+	pid_t processGroup = thisIsBackground || takeTerminal ? 0 : -1;//0 makes the first stage start a new group, -1 stays in the shell's
+	int previousRead = -1;//read end of the pipe coming out of the stage before
+	for(int i = 0; i < numStages; i++){
+		int pipeFds[2] = {-1, -1};
+		if(i < numStages - 1){//every stage but the last one writes into a pipe
+			if(pipe2(pipeFds, O_CLOEXEC) == -1){
+				printf("Error creating pipe\n");
+				fflush(stdout);
+				stages[numStages-1].launchError = 1;//the last stage never gets started
+				break;
+			}
+			if(pipeBufferSize > 0 && fcntl(pipeFds[1], F_SETPIPE_SZ, pipeBufferSize) == -1 && DEBUG){//bigger pipes mean fewer context switches for stages moving a lot of data
+				printf("Unable to resize pipe to %d bytes\n",pipeBufferSize);
+				fflush(stdout);
+			}
+		}
+		stages[i].inFd = previousRead;
+		stages[i].outFd = pipeFds[1];
+
+		pid_t spawnPid;
+		if(useFork){
+			spawnPid = launchWithFork(&stages[i], thisIsBackground, processGroup, options);
+		}else if(launchBackend == LAUNCH_ZYGOTE){
+			spawnPid = launchWithZygote(&stages[i], thisIsBackground, processGroup);
+		}else{
+			spawnPid = launchWithSpawn(&stages[i], thisIsBackground, processGroup);
+		}
+
+		if(spawnPid == -1){
+			traceEvent(TRACE_LAUNCH_FAIL, -1, stages[i].launchError, NULL);
+		}else{
+			traceEvent(useFork ? TRACE_FORK : launchBackend == LAUNCH_ZYGOTE ? TRACE_ZYGOTE : TRACE_SPAWN, spawnPid, 0, NULL);
+		}
+
+		//the children have their own copies of the pipe ends now
+		if(previousRead != -1){
+			close(previousRead);
+		}
+		if(pipeFds[1] != -1){
+			close(pipeFds[1]);
+		}
+		previousRead = pipeFds[0];
+
+		if(spawnPid != -1){
+			struct job *job = &jobTable->jobs[slot];
+			if(processGroup == 0){//the first stage that starts leads the process group for the rest
+				processGroup = spawnPid;
+				job->processGroup = spawnPid;
+				if(takeTerminal){//the child takes the terminal too, this covers a launch path that couldn't
+					tcsetpgrp(terminalFd, processGroup);
+				}
+			}
+			if(i == numStages - 1){
+				job->pid = spawnPid;
+			}
+			job->numProcesses++;
+			jobTableAddPid(jobTable, slot, spawnPid);
+		}
+	}
+	if(previousRead != -1){
+		close(previousRead);
+	}
+
+	struct job *job = &jobTable->jobs[slot];
+	if(job->pid == -1){//the last stage never started, so its error is the status of the job
+		job->status = W_EXITCODE(stages[numStages-1].launchError, 0);
+	}
+	if(job->numProcesses == 0){//nothing is running, so there is nothing to wait for
+		job->state = JOB_DONE;
+	}
+	return slot;
+}
+
+/* waitForJob(struct jobTable *, int, sigset_t *)
+ * Takes the job table, the slot of a foreground job, and the signal mask to wait with
+ * Returns nothing
+ * Waits for the SIGCHLD handler to reap every process in the job, then sets recentStatus, prints the times if the job was timed,
+ * and frees the slot. If the job has the terminal, the shell takes it back. A job that stops instead becomes a background job
+ * and stays in the table for fg and bg. SIGCHLD has to be blocked
+ */
+void waitForJob(struct jobTable *jobTable, int slot, sigset_t *waitMask){
+	traceEvent(TRACE_WAIT_START, jobTable->jobs[slot].pid, 0, NULL);
+	collectChildren(jobTable);
+	while(jobTable->jobs[slot].state != JOB_DONE && jobTable->jobs[slot].state != JOB_STOPPED){
+		sigsuspend(waitMask);
+		collectChildren(jobTable);
+	}
+	struct job *job = &jobTable->jobs[slot];
+	traceEvent(TRACE_WAIT_END, job->pid, job->status, NULL);
+	if(jobControl && job->processGroup > 0){//take the terminal back, along with the settings it had at the prompt
+		tcsetpgrp(terminalFd, shellGroup);
+		tcsetattr(terminalFd, TCSADRAIN, &shellModes);
+	}
+	if(job->state == JOB_STOPPED){
+		job->background = true;//from now on it is reported like any other background job
+		job->sequence = jobTable->nextSequence++;
+		printf("\n[%d] Stopped\t%s\n",job->id,job->commandText);
+		fflush(stdout);
+		recentStatus = job->stopSignal;
+		return;
+	}
+	int childStatus = job->status;
+	if(WIFEXITED(childStatus) == false){//If the child didn't exit properly
+		printf("terminated by signal %d\n",WTERMSIG(childStatus));//print termination signal
+		fflush(stdout);
+		recentStatus = WTERMSIG(childStatus);//set the status of the most recent command to the termination signal
+	}else{//if the child did exit properly
+		recentStatus = WEXITSTATUS(childStatus);//set the status of the most recent command to the exit status
+	}
+	if(job->timed){
+		printTimes(&job->startTime, &job->endTime, &job->usage);
+	}
+	snprintf(recentLimits, sizeof(recentLimits), "%s", job->limits == NULL ? "" : job->limits);//for the status command
+	jobTableRelease(jobTable, slot);
+}
+
+/* updateJobs(struct jobTable *)
+ * Takes the job table as input
+ * Returns nothing
+ * Picks up anything the SIGCHLD handler has reaped since the last prompt, so the job builtins see every job as it is now
+ */
+void updateJobs(struct jobTable *jobTable){
+	sigset_t childMask, oldMask;
+	sigemptyset(&childMask);
+	sigaddset(&childMask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &childMask, &oldMask);
+	collectChildren(jobTable);
+	sigprocmask(SIG_SETMASK, &oldMask, NULL);
+}
+
+/* currentJob(struct jobTable *)
+ * Takes the job table as input
+ * Returns the slot of the job that was started, stopped or sent to the background most recently, or -1 if there are no jobs
+ */
+int currentJob(struct jobTable *jobTable){
+	int current = -1;
+	for(int i = 0; i < jobTable->capacity; i++){
+		struct job *job = &jobTable->jobs[i];
+		if((job->state == JOB_RUNNING || job->state == JOB_STOPPED) && (current == -1 || job->sequence > jobTable->jobs[current].sequence)){
+			current = i;
+		}
+	}
+	return current;
+}
+
+/* findJob(struct jobTable *, char *)
+ * Takes the job table and a job the way the user wrote it as inputs: %n for job n, %+ or %% for the current job,
+ * or the pid of any process in the job. NULL is the current job
+ * Returns the slot of the job, or -1 if there isn't a running or stopped job like that
+ */
+int findJob(struct jobTable *jobTable, char *spec){
+	if(spec == NULL || strcmp(spec, "%+") == 0 || strcmp(spec, "%%") == 0){
+		return currentJob(jobTable);
+	}
+	char *number = spec[0] == '%' ? spec + 1 : spec;
+	char *end;
+	long value = strtol(number, &end, 10);
+	if(end == number || *end != '\0'){
+		return -1;
+	}
+	int slot = -1;
+	if(spec[0] == '%'){
+		slot = value >= 1 && value <= jobTable->capacity ? value - 1 : -1;
+	}else{
+		int spot = jobTableFindPid(jobTable, value);
+		slot = spot == -1 ? -1 : jobTable->pids[spot].slot;
+	}
+	if(slot == -1 || (jobTable->jobs[slot].state != JOB_RUNNING && jobTable->jobs[slot].state != JOB_STOPPED)){
+		return -1;
+	}
+	return slot;
+}
+
+/* jobsCommand(struct jobTable *)
+ * Takes the job table as input
+ * Returns nothing
+ * Lists every running and stopped job with its process group and the launch options it was started with. The current job has a +
+ */
+void jobsCommand(struct jobTable *jobTable){
+	updateJobs(jobTable);
+	int current = currentJob(jobTable);
+	for(int i = 0; i < jobTable->capacity; i++){
+		struct job *job = &jobTable->jobs[i];
+		if(job->state != JOB_RUNNING && job->state != JOB_STOPPED){
+			continue;
+		}
+		printf("[%d]%c %-8s %d\t%s",job->id,i == current ? '+' : ' ',job->state == JOB_STOPPED ? "Stopped" : "Running",job->processGroup > 0 ? job->processGroup : job->pid,job->commandText);
+		if(job->limits != NULL){
+			printf("\t(with %s)",job->limits);
+		}
+		printf("\n");
+	}
+	fflush(stdout);
+	recentStatus = 0;
+}
+
+/* fgCommand(char *[], int, struct jobTable *)
+ * Takes the arguments for the fg builtin, the number of arguments, and the job table as inputs
+ * Returns nothing
+ * Brings a job to the foreground, giving it the terminal and starting it again if it is stopped, then waits for it like any foreground job
+ */
+void fgCommand(char *command[], int numArguments, struct jobTable *jobTable){
+	if(numArguments > 2){
+		printf("Usage: fg [job]\n");
+		fflush(stdout);
+		recentStatus = 1;
+		return;
+	}
+	updateJobs(jobTable);
+	int slot = findJob(jobTable, numArguments == 2 ? command[1] : NULL);
+	if(slot == -1){
+		printf("Error: no such job\n");
+		fflush(stdout);
+		recentStatus = 1;
+		return;
+	}
+	struct job *job = &jobTable->jobs[slot];
+	printf("%s\n",job->commandText);
+	fflush(stdout);
+
+	sigset_t childMask, oldMask;
+	sigemptyset(&childMask);
+	sigaddset(&childMask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &childMask, &oldMask);
+	job->background = false;
+	if(jobControl && job->processGroup > 0){
+		tcsetpgrp(terminalFd, job->processGroup);
+	}
+	if(job->state == JOB_STOPPED){
+		job->state = JOB_RUNNING;//set here so the wait doesn't see it as stopped before the SIGCONT lands
+		signalJob(jobTable, slot, SIGCONT);
+	}
+	waitForJob(jobTable, slot, &oldMask);
+	sigprocmask(SIG_SETMASK, &oldMask, NULL);
+}
+
+/* bgCommand(char *[], int, struct jobTable *)
+ * Takes the arguments for the bg builtin, the number of arguments, and the job table as inputs
+ * Returns nothing
+ * Starts a stopped job again in the background, with one SIGCONT to its whole process group
+ */
+void bgCommand(char *command[], int numArguments, struct jobTable *jobTable){
+	if(numArguments > 2){
+		printf("Usage: bg [job]\n");
+		fflush(stdout);
+		recentStatus = 1;
+		return;
+	}
+	updateJobs(jobTable);
+	int slot = findJob(jobTable, numArguments == 2 ? command[1] : NULL);
+	if(slot == -1){
+		printf("Error: no such job\n");
+		fflush(stdout);
+		recentStatus = 1;
+		return;
+	}
+	struct job *job = &jobTable->jobs[slot];
+	recentStatus = 0;
+	if(job->state != JOB_STOPPED){
+		printf("Error: job %d is already running\n",job->id);
+		fflush(stdout);
+		return;
+	}
+	job->state = JOB_RUNNING;
+	job->background = true;
+	job->sequence = jobTable->nextSequence++;
+	signalJob(jobTable, slot, SIGCONT);
+	printf("[%d] %s &\n",job->id,job->commandText);
+	fflush(stdout);
+}
+
+/* struct signalName
+ * A signal the kill builtin knows by name
+ */
+struct signalName{
+	char *name;
+	int signal;
+};
+
+struct signalName signalNames[] = {{"HUP", SIGHUP}, {"INT", SIGINT}, {"QUIT", SIGQUIT}, {"KILL", SIGKILL}, {"USR1", SIGUSR1}, {"USR2", SIGUSR2},
+	{"TERM", SIGTERM}, {"CONT", SIGCONT}, {"STOP", SIGSTOP}, {"TSTP", SIGTSTP}, {"TTIN", SIGTTIN}, {"TTOU", SIGTTOU}};
+
+/* hasJobArgument(char *[], int)
+ * Takes the arguments of a command and the number of arguments as inputs
+ * Returns true if one of the arguments is a %job, so the kill builtin runs instead of the kill command
+ */
+bool hasJobArgument(char *command[], int numArguments){
+	for(int i = 1; i < numArguments; i++){
+		if(command[i][0] == '%'){
+			return true;
+		}
+	}
+	return false;
+}
+
+/* killCommand(char *[], int, struct jobTable *)
+ * Takes the arguments for the kill builtin, the number of arguments, and the job table as inputs
+ * Returns nothing
+ * "kill [-signal] target..." sends a signal, SIGTERM by default, to each target. A %n target gets it with one killpg to the
+ * job's process group, so a whole pipeline is stopped or killed at once, and a pid gets it on its own
+ */
+void killCommand(char *command[], int numArguments, struct jobTable *jobTable){
+	int signal = SIGTERM;
+	int first = 1;
+	if(numArguments > 1 && command[1][0] == '-'){
+		char *name = command[1] + 1;
+		char *end;
+		signal = strtol(name, &end, 10);
+		if(end == name || *end != '\0'){
+			if(strncmp(name, "SIG", 3) == 0){
+				name += 3;
+			}
+			signal = -1;
+			for(size_t i = 0; i < sizeof(signalNames) / sizeof(signalNames[0]); i++){
+				if(strcmp(name, signalNames[i].name) == 0){
+					signal = signalNames[i].signal;
+				}
+			}
+		}
+		if(signal < 0 || signal >= NSIG){
+			printf("Error: unknown signal \"%s\"\n",command[1]);
+			fflush(stdout);
+			recentStatus = 1;
+			return;
+		}
+		first = 2;
+	}
+	if(first == numArguments){
+		printf("Usage: kill [-signal] %%job|pid...\n");
+		fflush(stdout);
+		recentStatus = 1;
+		return;
+	}
+	recentStatus = 0;
+	updateJobs(jobTable);
+	for(int i = first; i < numArguments; i++){
+		if(command[i][0] == '%'){
+			int slot = findJob(jobTable, command[i]);
+			if(slot == -1){
+				printf("Error: no such job \"%s\"\n",command[i]);
+				fflush(stdout);
+				recentStatus = 1;
+				continue;
+			}
+			signalJob(jobTable, slot, signal);
+			if(jobTable->jobs[slot].state == JOB_STOPPED && (signal == SIGTERM || signal == SIGHUP)){//a stopped job only gets these once it is started again
+				signalJob(jobTable, slot, SIGCONT);
+			}
+			continue;
+		}
+		char *end;
+		long pid = strtol(command[i], &end, 10);
+		if(end == command[i] || *end != '\0' || kill(pid, signal) == -1){
+			printf("Error: unable to signal \"%s\"\n",command[i]);
+			fflush(stdout);
+			recentStatus = 1;
+		}
+	}
+}
+
+/* waitCommand(char *[], int, struct jobTable *)
+ * Takes the arguments for the wait builtin, the number of arguments, and the job table as inputs
+ * Returns nothing
+ * With no arguments, sleeps until every running background job is done. Otherwise waits for each job given and sets recentStatus
+ * to the status of the last one. The shell sleeps in sigsuspend the whole time instead of polling, and ^C stops the wait
+ */
+void waitCommand(char *command[], int numArguments, struct jobTable *jobTable){
+	sigset_t waitSignals, oldMask;//SIGINT is blocked too, so a ^C between checking the flag and sleeping isn't missed
+	sigemptyset(&waitSignals);
+	sigaddset(&waitSignals, SIGCHLD);
+	sigaddset(&waitSignals, SIGINT);
+	sigprocmask(SIG_BLOCK, &waitSignals, &oldMask);
+	struct sigaction interrupt_action = {{0}}, previous_action;
+	interrupt_action.sa_handler = handle_SIGINT_wait;
+	sigaction(SIGINT, &interrupt_action, &previous_action);
+	waitInterrupted = 0;
+	recentStatus = 0;
+
+	if(numArguments == 1){
+		collectChildren(jobTable);
+		while(waitInterrupted == 0){
+			bool running = false;
+			for(int i = 0; i < jobTable->capacity && running == false; i++){
+				running = jobTable->jobs[i].state == JOB_RUNNING && jobTable->jobs[i].background;
+			}
+			if(running == false){
+				break;
+			}
+			sigsuspend(&oldMask);
+			collectChildren(jobTable);
+		}
+	}
+	for(int i = 1; i < numArguments && waitInterrupted == 0; i++){
+		int slot = findJob(jobTable, command[i]);
+		if(slot == -1 || jobTable->jobs[slot].background == false){
+			printf("Error: no such job \"%s\"\n",command[i]);
+			fflush(stdout);
+			recentStatus = 127;
+			continue;
+		}
+		struct job *job = &jobTable->jobs[slot];
+		job->waited = true;//keeps the job in the table after it is done, so its status can be read
+		collectChildren(jobTable);
+		while(job->state == JOB_RUNNING && waitInterrupted == 0){
+			sigsuspend(&oldMask);
+			collectChildren(jobTable);
+		}
+		job->waited = false;
+		if(job->state == JOB_STOPPED){
+			printf("Error: job %d is stopped\n",job->id);
+			fflush(stdout);
+			recentStatus = 1;
+		}else if(job->state == JOB_DONE){
+			recentStatus = WIFEXITED(job->status) ? WEXITSTATUS(job->status) : WTERMSIG(job->status);
+			jobTableRelease(jobTable, slot);
+		}
+	}
+
+	if(waitInterrupted){
+		printf("\n");
+		fflush(stdout);
+		recentStatus = SIGINT;
+	}
+	sigaction(SIGINT, &previous_action, NULL);
+	sigprocmask(SIG_SETMASK, &oldMask, NULL);
+}
+
+/* buildTask(char *[], int, char *, struct arena *, int *)
+ * Takes the command template for the parallel builtin, the number of words in it, one input, an arena, and a pointer to store the number of arguments
+ * Returns a NULL terminated argument array for the task, allocated from the arena
+ * Every "{}" in the template is replaced with the input. If there aren't any, the input is added to the end as its own argument
+ */
+char **buildTask(char *template[], int numWords, char *input, struct arena *arena, int *numArguments){
+	char **task = arenaAlloc(arena, (numWords + 2) * sizeof(char *));
+	size_t inputLength = strlen(input);
+	bool usedInput = false;
+	for(int i = 0; i < numWords; i++){
+		char *word = template[i];
+		int numReplacements = 0;
+		for(char *found = strstr(word, "{}"); found != NULL; found = strstr(found + 2, "{}")){
+			numReplacements++;
+		}
+		if(numReplacements == 0){
+			task[i] = word;
+			continue;
+		}
+		usedInput = true;
+		char *replaced = arenaAlloc(arena, strlen(word) + numReplacements * inputLength + 1);
+		char *end = replaced;
+		char *rest = word;
+		for(char *found = strstr(rest, "{}"); found != NULL; found = strstr(rest, "{}")){//copy everything up to each {} and then the input
+			memcpy(end, rest, found - rest);
+			end += found - rest;
+			memcpy(end, input, inputLength);
+			end += inputLength;
+			rest = found + 2;
+		}
+		strcpy(end, rest);
+		task[i] = replaced;
+	}
+	*numArguments = numWords;
+	if(usedInput == false){
+		task[numWords] = input;
+		*numArguments = numWords + 1;
+	}
+	task[*numArguments] = NULL;
+	return task;
+}
+
+/* finishTask(struct jobTable *, int, int, int *)
+ * Takes the job table, the slot of a finished task, the task's number, and a pointer to the number of failed tasks
+ * Returns nothing
+ * Reports the task's exit value, counts it if it failed, and frees its slot
+ */
+void finishTask(struct jobTable *jobTable, int slot, int taskNumber, int *numFailed){
+	struct job *job = &jobTable->jobs[slot];
+	if(WIFEXITED(job->status)){
+		printf("task %d (%s): exit value %d\n",taskNumber,job->commandText,WEXITSTATUS(job->status));
+		if(WEXITSTATUS(job->status) != 0){
+			*numFailed = *numFailed + 1;
+		}
+	}else{
+		printf("task %d (%s): terminated by signal %d\n",taskNumber,job->commandText,WTERMSIG(job->status));
+		*numFailed = *numFailed + 1;
+	}
+	fflush(stdout);
+	jobTableRelease(jobTable, slot);
+}
+
+/* parallelCommand(char *[], int, struct jobTable *)
+ * Takes the arguments for the parallel builtin, the number of arguments, and the job table
+ * Returns nothing
+ * Runs "parallel [-j N] command ... ::: input ..." (or ":::: file" to read one input per line, "-" for stdin) with up to N tasks at
+ * a time, N being the number of online CPUs unless given. A new task starts as soon as the SIGCHLD handler reaps one that finished.
+ * Each task goes through launchJob like any other foreground command, so it gets the same pipes, redirection and signal setup.
+ * recentStatus is the number of failed tasks, capped at 101 like GNU parallel
+ */
+void parallelCommand(char *command[], int numArguments, struct jobTable *jobTable){
+	long maxRunning = sysconf(_SC_NPROCESSORS_ONLN);
+	int first = 1;//first word of the command template
+	if(first < numArguments && strncmp(command[first], "-j", 2) == 0){
+		char *count = command[first] + 2;//the count can be attached, like -j4, or the next argument
+		if(*count == '\0' && first + 1 < numArguments){
+			first++;
+			count = command[first];
+		}
+		maxRunning = strtol(count, NULL, 10);
+		first++;
+	}
+	int separator = first;//where the ::: or :::: is
+	while(separator < numArguments && strcmp(command[separator], ":::") != 0 && strcmp(command[separator], "::::") != 0){
+		separator++;
+	}
+	if(maxRunning < 1 || separator == first || separator == numArguments){
+		printf("Usage: parallel [-j N] command [args...] ::: input... | :::: file\n");
+		fflush(stdout);
+		recentStatus = 1;
+		return;
+	}
+
+	struct inputReader inputFile;//inputs for ":::: file", one per line
+	bool readFromFile = strcmp(command[separator], "::::") == 0;
+	if(readFromFile){
+		if(separator + 2 != numArguments){
+			printf("Error: \"::::\" takes one file\n");
+			fflush(stdout);
+			recentStatus = 1;
+			return;
+		}
+		if(strcmp(command[separator+1], "-") == 0 && commandFd == 0 && isatty(0) == false){//a second buffered reader on piped commands would take the shell's lines
+			printf("Error: \":::: -\" can't read stdin while the shell is reading a batch of commands from it\n");
+			fflush(stdout);
+			recentStatus = 1;
+			return;
+		}
+		int fd = strcmp(command[separator+1], "-") == 0 ? 0 : open(command[separator+1], O_RDONLY | O_CLOEXEC);
+		if(fd == -1){
+			printf("Error opening file \"%s\"\n",command[separator+1]);
+			fflush(stdout);
+			recentStatus = 1;
+			return;
 		}
+		openReader(&inputFile, fd);
 	}
-	//return if the string is only spaces
-	return onlySpaces;
 
-}
+	int *running = malloc(maxRunning * sizeof(int));//slots of the tasks that are running
+	int *runningNumbers = malloc(maxRunning * sizeof(int));//task numbers of the tasks that are running, for the reports
+	if(running == NULL || runningNumbers == NULL){
+		free(running);
+		free(runningNumbers);
+		printf("Error: not enough memory to start another process.\n");
+		fflush(stdout);
+		recentStatus = 1;
+		return;
+	}
+	int numRunning = 0;
+	int numTasks = 0;
+	int numFailed = 0;
+	int nextInput = separator + 1;//next input when they are given on the command line
+	bool moreInput = true;
+	struct arena taskArena = {0};//arguments for the task being started, reset after each one
 
-/* convertToWords(char [], int, char [][])
- * Takes a char array, a string array, and an integer as inputs
- * Returns the number of words in the input string
- * Fills the words into an output array
- */
-int convertToWords(char userInput[], int numCharacters, char outputWords[MAX_NUM_ARGUMENTS][MAX_INPUT_LENGTH]){
-	int wordCount = 0;
-	//Loops through each character in userInput
-	for(int i = 0; i <= numCharacters; i++){
-		//If the character is a space, null terminator, or newline, skip to the next character
-		//This means that the commands will still be successfully pulled even with extra spaces
-		if(userInput[i] != ' ' && userInput[i] != '\0' && userInput[i] != '\n'){
-			int wordLength = 0;
-			//set the starting position of the word
-			int wordStart = i;
-			//loop starting at the word and going to the end of the string
-			for(int x = wordStart; x <= numCharacters; x++){
-				//if another space is reached, or a newline or null terminator is found, then that is the end of the word
-				//Otherwise increase the length of the word by 1
-				if(userInput[x] != ' ' && userInput[x] != '\0' && userInput[x] != '\n'){
-					wordLength++;
-				}else{
-					//if the end of the word is found, skip i ahead to the end of the word and break the loop
-					i = x;
+	sigset_t childMask, oldMask;//block SIGCHLD so no task can be reaped before it is in the job table, and SIGINT so a ^C isn't missed before sleeping
+	sigemptyset(&childMask);
+	sigaddset(&childMask, SIGCHLD);
+	sigaddset(&childMask, SIGINT);
+	sigprocmask(SIG_BLOCK, &childMask, &oldMask);
+	struct sigaction interrupt_action = {{0}}, previous_action;//^C stops parallel from starting any more tasks, the same way it stops wait
+	interrupt_action.sa_handler = handle_SIGINT_wait;
+	sigaction(SIGINT, &interrupt_action, &previous_action);
+	waitInterrupted = 0;
+	bool tasksSignaled = false;//if the running tasks have been sent SIGINT after a ^C
+
+	while((moreInput && waitInterrupted == 0) || numRunning > 0){
+		if(waitInterrupted && tasksSignaled == false){//make sure every running task gets the ^C, then keep reaping until they are gone
+			for(int i = 0; i < numRunning; i++){
+				signalJob(jobTable, running[i], SIGINT);
+			}
+			tasksSignaled = true;
+		}
+		while(moreInput && waitInterrupted == 0 && numRunning < maxRunning){//fill every free worker
+			char *input;
+			if(readFromFile){
+				int length = readLine(&inputFile, &input);
+				if(length == -1){
+					moreInput = false;
+					break;
+				}
+				if(length == 0){//skip blank lines
+					continue;
+				}
+			}else{
+				if(nextInput == numArguments){
+					moreInput = false;
 					break;
 				}
+				input = command[nextInput];
+				nextInput++;
+			}
+
+			int taskArguments;
+			char **task = buildTask(&command[first], separator - first, input, &taskArena, &taskArguments);
+			char *commandText = joinWords(task, taskArguments);
+			struct stage *stages;
+			int numStages = commandText == NULL ? -1 : splitPipeline(task, taskArguments, &taskArena, &stages);
+			numTasks++;
+			int slot = -1;
+			if(numStages == -1){
+				printf("Error: unable to start task %d\n",numTasks);
+				fflush(stdout);
+				free(commandText);
+			}else{
+				slot = launchJob(jobTable, stages, numStages, false, false, commandText, NULL);
 			}
-			//put the word into the outputWords array
-			for(int j = wordStart; j < wordStart+wordLength; j++){
-				outputWords[wordCount][j-wordStart] = userInput[j];
+			arenaReset(&taskArena);
+			if(slot == -1){
+				numFailed++;
+			}else if(jobTable->jobs[slot].state == JOB_DONE){//nothing in the task could be started
+				finishTask(jobTable, slot, numTasks, &numFailed);
+			}else{
+				running[numRunning] = slot;
+				runningNumbers[numRunning] = numTasks;
+				numRunning++;
 			}
-			//add a null terminator to the end of the word
-			outputWords[wordCount][wordLength] = '\0';
-			//increase the total number of words by 1
-			wordCount++;
 		}
-	}
-	return wordCount;
-}
+		if(numRunning == 0){
+			continue;
+		}
 
-//handle_SIGINT
-//SIGINT should just exit if passed
-void handle_SIGINT(int signo){
-	exit(2);
-}
+		if(waitInterrupted && tasksSignaled == false){//the ^C came while starting tasks, signal them before sleeping
+			continue;
+		}
+		sigsuspend(&oldMask);//sleep until a task finishes
+		collectChildren(jobTable);
+		for(int i = 0; i < numRunning; i++){
+			if(jobTable->jobs[running[i]].state == JOB_DONE){
+				finishTask(jobTable, running[i], runningNumbers[i], &numFailed);
+				numRunning--;
+				running[i] = running[numRunning];//move the last running task into this spot
+				runningNumbers[i] = runningNumbers[numRunning];
+				i--;
+			}
+		}
+	}
+	sigaction(SIGINT, &previous_action, NULL);
+	sigprocmask(SIG_SETMASK, &oldMask, NULL);
 
-//handleSIGTSTP
-//SIGTSTP will toggle the foreground only mode for the shell, and let the main function know to print the change
-void handle_SIGTSTP(int signo){
+	if(waitInterrupted){
+		printf("\nparallel: interrupted, the remaining inputs were not started\n");
+	}
+	printf("parallel: %d tasks, %d succeeded, %d failed\n",numTasks,numTasks - numFailed,numFailed);
+	fflush(stdout);
+	recentStatus = numFailed > 101 ? 101 : numFailed;
+	if(waitInterrupted){
+		recentStatus = SIGINT;
+	}
 
-	if(foregroundOnly){//toggle foregroundOnly
-		foregroundOnly = false;
-	}else{
-		foregroundOnly = true;
+	free(running);
+	free(runningNumbers);
+	arenaFree(&taskArena);
+	if(readFromFile){
+		closeReader(&inputFile);
 	}
-	modeChanged = true;//set modeChanged to true so the main function will print a message.
+}
 
+/* isBuiltin(char *[], int)
+ * Takes an array of strings and an int as inputs
+ * Returns true if handleCommand runs the command in the shell instead of starting a process for it
+ */
+bool isBuiltin(char *command[], int numArguments){
+	char *builtins[] = {"exit", "cd", "status", "hash", "trace", "history", "copy", "export", "unset", "jobs", "fg", "bg", "wait", "parallel"};
+	for(size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++){
+		if(strcmp(command[0], builtins[i]) == 0){
+			return true;
+		}
+	}
+	return (strcmp(command[0], "env") == 0 && numArguments == 1) || (strcmp(command[0], "kill") == 0 && hasJobArgument(command, numArguments));
 }
 
 /*handleCommand
- *takes an array of strings, an integer representing the length of the array, a pointer to a bool, an int array of currently running pids, and a length for that array
+ *takes a NULL terminated array of strings, an integer representing the length of the array, a pointer to a bool, the job table, and the command's arena
  *This function will take an array of arguments for a command and determine if the command is valid.
- *If the command is one of the built in commands, it will run it, otherwise it will determine if it is a background process, and if it should redirect the input and/or output.
- *Afterwards, it will pass the command to exec and run it there.
+ *If the command is one of the built in commands, it will run it, otherwise it will determine if it is a background process, split it into pipeline stages, and find the redirections for each stage.
+ *Afterwards, it will launch every stage and wait for the last one if it is in the foreground.
 */
-void handleCommand(char command[MAX_NUM_ARGUMENTS][MAX_INPUT_LENGTH], int numArguments, bool *repeat, int currentProcesses[MAX_BACKGROUND_PROCESSES], int *numBackground){
+void handleCommand(char *command[], int numArguments, bool *repeat, struct jobTable *jobTable, struct arena *arena){
 	
+	//anything but status and a background job sets a new status, so the launch options of the last job stop applying to it
+	if(numArguments >= 1 && strcmp(command[0],"status") != 0 && (command[numArguments-1] != backgroundOperator || isBuiltin(command, numArguments))){
+		recentLimits[0] = '\0';
+	}
+
+	bool timed = false;//if the command has the time prefix
+	struct timespec startTime;//when a timed builtin started, and how much CPU the shell had used by then
+	struct rusage startUsage;
+	struct launchOptions launchOptions;
+	struct launchOptions *options = NULL;//limits from the with prefix, NULL if there wasn't one
+	while(numArguments > 1){//time and with are prefixes, in either order
+		if(timed == false && strcmp(command[0],"time") == 0){//take time off and run the rest of the command
+			command++;
+			numArguments--;
+			timed = true;
+			clock_gettime(CLOCK_MONOTONIC, &startTime);
+			getrusage(RUSAGE_SELF, &startUsage);
+		}else if(options == NULL && strcmp(command[0],"with") == 0){//the limits are applied to every process in the command
+			int used = parseLaunchOptions(command, numArguments, &launchOptions);
+			if(used == -1){
+				recentStatus = 1;
+				return;
+			}
+			command += used;
+			numArguments -= used;
+			options = &launchOptions;
+		}else{
+			break;
+		}
+	}
+	if(options != NULL && numArguments >= 1 && isBuiltin(command, numArguments)){//builtins run in the shell, so there is no new process to apply the limits to
+		printf("Error: \"with\" can't be used with the builtin \"%s\"\n",command[0]);
+		fflush(stdout);
+		recentStatus = 1;
+		return;
+	}
+
 	//If there are no arguments, don't do anything
 	if(numArguments >= 1){
 
@@ -165,35 +3737,62 @@ void handleCommand(char command[MAX_NUM_ARGUMENTS][MAX_INPUT_LENGTH], int numArg
 				 printf("Exit command found... Exiting...\n");
 				fflush(stdout);
 			}
-			for(int i = 0; i < *numBackground; i++){
-				if(currentProcesses[i] != -1){
-					kill(currentProcesses[i], SIGTERM);
+			for(int i = 0; i < jobTable->capacity; i++){//stop every background job that is still running or stopped
+				if((jobTable->jobs[i].state == JOB_RUNNING || jobTable->jobs[i].state == JOB_STOPPED) && jobTable->jobs[i].background){
+					signalJob(jobTable, i, SIGTERM);//one killpg reaches every process in the pipeline
+					if(jobTable->jobs[i].state == JOB_STOPPED){//a stopped process only gets the SIGTERM once it is started again
+						signalJob(jobTable, i, SIGCONT);
+					}
 				}
 			}
-			printf("\n");
-			fflush(stdout);
+			if(interactive){//end the line the prompt was on
+				printf("\n");
+				fflush(stdout);
+			}
 			*repeat = false;
 		}
 	}
 	else if(strcmp(command[0],"cd") == 0){//cd command found as first argument
+		recentStatus = 0;//set so && and || can tell if cd worked
 		if(numArguments == 1){//if there are no extra arguments besides just cd, change to the home directory
 			if(DEBUG) {
 				printf("Changing to home directory...\n");
 				fflush(stdout);
 			}
-			chdir(getenv("HOME"));//change to home directory
+			char *home = getVariable("HOME", 4);
+			if(home == NULL || changeDirectory(home) == false){//change to home directory
+				printf("Error: unable to change to home directory\n");
+				fflush(stdout);
+				recentStatus = 1;
+			}
+		}else if(numArguments == 2 && strcmp(command[1], "-") == 0){//cd - goes back to the previous directory and prints it
+			char *previous = getVariable("OLDPWD", 6);
+			if(previous == NULL){
+				printf("Error: OLDPWD not set\n");
+				fflush(stdout);
+				recentStatus = 1;
+			}else if(changeDirectory(previous) == false){
+				printf("Error: unable to change to directory %s...\n",previous);
+				fflush(stdout);
+				recentStatus = 1;
+			}else{
+				printf("%s\n",environment.directory != NULL ? environment.directory : previous);
+				fflush(stdout);
+			}
 		}else if(numArguments == 2){//If there are more 
 			if(DEBUG){
 				printf("Attempting to change to directory %s...\n",command[1]);
 				fflush(stdout);
 			}
-			if(chdir(command[1]) == -1){//If changing directories fails, print an error
+			if(changeDirectory(command[1]) == false){//If changing directories fails, print an error
 				printf("Error: unable to change to directory %s...\n",command[1]);
 				fflush(stdout);
+				recentStatus = 1;
 			}
 		}else{
 			printf("Error: too many arguments for command \"cd\"\n");//if more than 2 arguments are found, print an error
 			fflush(stdout);
+			recentStatus = 1;
 			
 		}
 			
@@ -207,230 +3806,626 @@ void handleCommand(char command[MAX_NUM_ARGUMENTS][MAX_INPUT_LENGTH], int numArg
 				fflush(stdout);
 			}
 			printf("Exit value %i\n",recentStatus);
+			if(recentLimits[0] != '\0'){//the last foreground command was started with launch options
+				printf("Launched with %s\n",recentLimits);
+			}
 			fflush(stdout);
 		}
+	}else if(strcmp(command[0],"hash") == 0){//hash command found as first argument, lists or clears the PATH cache
+		hashCommand(command, numArguments);
+	}else if(strcmp(command[0],"trace") == 0){//trace command found as first argument, turns the trace log on or off
+		traceCommand(command, numArguments);
+	}else if(strcmp(command[0],"history") == 0){//history command found as first argument, lists or searches past commands
+		historyCommand(command, numArguments);
+	}else if(strcmp(command[0],"copy") == 0){//copy command found as first argument, copies a file without starting a process
+		copyCommand(command, numArguments, arena);
+	}else if(strcmp(command[0],"export") == 0){//export command found as first argument, sets variables for the shell and the commands it starts
+		exportCommand(command, numArguments);
+	}else if(strcmp(command[0],"unset") == 0){//unset command found as first argument, removes variables
+		unsetCommand(command, numArguments);
+	}else if(strcmp(command[0],"env") == 0 && numArguments == 1){//env by itself lists the environment, with arguments it is the external command
+		for(int i = 0; i < environment.numVariables; i++){
+			printf("%s\n",environment.variables[i]);
+		}
+		fflush(stdout);
+		recentStatus = 0;
+	}else if(strcmp(command[0],"jobs") == 0){//jobs command found as first argument, lists the running and stopped jobs
+		jobsCommand(jobTable);
+	}else if(strcmp(command[0],"fg") == 0){//fg command found as first argument, brings a job to the foreground
+		fgCommand(command, numArguments, jobTable);
+	}else if(strcmp(command[0],"bg") == 0){//bg command found as first argument, starts a stopped job in the background
+		bgCommand(command, numArguments, jobTable);
+	}else if(strcmp(command[0],"kill") == 0 && hasJobArgument(command, numArguments)){//kill with a %job, only the shell knows the job's process group
+		killCommand(command, numArguments, jobTable);
+	}else if(strcmp(command[0],"wait") == 0){//wait command found as first argument, waits for background jobs to finish
+		waitCommand(command, numArguments, jobTable);
+	}else if(strcmp(command[0],"parallel") == 0){//parallel command found as first argument, runs a command over many inputs
+		parallelCommand(command, numArguments, jobTable);
 	}else{//If none of the default commands are found, setup code for exec
 		
 		bool thisIsBackground = false;//bool to keep track of if the command should be a background process
-		if(strcmp(command[numArguments-1],"&") == 0){//checks if the last argument in the command is "&"
+		if(command[numArguments-1] == backgroundOperator){//checks if the last argument in the command is "&"
 			if(foregroundOnly == false){//If the shell isn't currently in foreground only mode
 				thisIsBackground = true;//set this command to be a background process
 			}
 			numArguments -= 1;//lower the number of arguments by 1 so "&" isn't included in the exec call
 		}
-
-		int childStatus;
-		pid_t spawnPid = fork();//create fork
-		if(spawnPid == -1){//if the fork failed, print an error
-			printf("Error creating child process\n");
+		char *commandText = joinWords(command, numArguments);//save the command for reports before the arguments get split up
+		if(commandText == NULL){
+			printf("Error: not enough memory to start another process.\n");
 			fflush(stdout);
-		}else if(spawnPid == 0){
-			//This is the child process
-			if(DEBUG){
-				printf("Child pid: %d, Running command %s\n",getpid(),command[0]);
-				fflush(stdout);
+			return;
+		}
+		struct stage *stages;
+		int numStages = splitPipeline(command, numArguments, arena, &stages);//split the command on "|" and find the redirections for each part
+		if(numStages == -1){
+			printf("Error: missing command in pipeline\n");
+			fflush(stdout);
+			free(commandText);
+			recentStatus = 1;
+			return;
+		}
+		if(numStages == 1 && thisIsBackground == false && options == NULL && strcmp(stages[0].command[0],"cat") == 0 && catCommand(&stages[0])){//plain cat is run in the shell
+			free(commandText);
+		}else{
+			//block SIGCHLD while launching so the children can't be reaped before they are added to the job table
+			sigset_t childMask, oldMask;
+			sigemptyset(&childMask);
+			sigaddset(&childMask, SIGCHLD);
+			sigprocmask(SIG_BLOCK, &childMask, &oldMask);
+
+			int slot = launchJob(jobTable, stages, numStages, thisIsBackground, jobControl && thisIsBackground == false, commandText, options);
+			if(slot != -1){
+				jobTable->jobs[slot].timed = timed;//the job's own usage is reported when it is done
+				timed = false;
+				if(thisIsBackground == false){//wait for foreground jobs to finish
+					waitForJob(jobTable, slot, &oldMask);
+				}else if(jobTable->jobs[slot].state == JOB_DONE){//a background job that didn't start anything has nothing to report
+					jobTableRelease(jobTable, slot);
+				}else{
+					lastBackgroundPid = jobTable->jobs[slot].pid;
+				}
 			}
+			sigprocmask(SIG_SETMASK, &oldMask, NULL);
+		}
+	}
+	}
 
-			bool changedIn = false;//changedIn and changedOut keep track if the input and/or output have been redirected
-			bool changedOut = false;
+	if(timed){//a timed builtin ran in the shell itself, so report the shell's own usage while it ran
+		struct timespec endTime;
+		struct rusage endUsage;
+		clock_gettime(CLOCK_MONOTONIC, &endTime);
+		getrusage(RUSAGE_SELF, &endUsage);
+		timersub(&endUsage.ru_utime, &startUsage.ru_utime, &endUsage.ru_utime);
+		timersub(&endUsage.ru_stime, &startUsage.ru_stime, &endUsage.ru_stime);
+		endUsage.ru_nvcsw -= startUsage.ru_nvcsw;
+		endUsage.ru_nivcsw -= startUsage.ru_nivcsw;
+		printTimes(&startTime, &endTime, &endUsage);
+	}
+}
+/* appendExpansion(char *, size_t)
+ * Takes a string and its length as inputs
+ * Returns nothing
+ * Adds the string to the end of the expansion buffer, doubling the buffer when it runs out of room
+ */
+void appendExpansion(char *text, size_t length){
+	if(expansionLength + length + 1 > expansionCapacity){
+		size_t newCapacity = expansionCapacity == 0 ? 256 : expansionCapacity;
+		while(expansionLength + length + 1 > newCapacity){
+			newCapacity *= 2;
+		}
+		char *newBuffer = realloc(expansionBuffer, newCapacity);
+		if(newBuffer == NULL){//if there is no memory left, the shell can't keep going
+			printf("Error: out of memory\n");
+			fflush(stdout);
+			exit(1);
+		}
+		expansionBuffer = newBuffer;
+		expansionCapacity = newCapacity;
+	}
+	memcpy(expansionBuffer + expansionLength, text, length);
+	expansionLength += length;
+}
 
-			for(int x = 0; x < 2; x++){//runs twice, checking the second to last argument each time for redirection symbols
-				int i = numArguments-2;
-				if(strcmp(command[i],">") == 0 && changedOut == false){//check if the output redirection symbol is found. changedOut makes sure this only happens once
-					//redirect output
-					char *newFilePath = command[i+1];// get the new file path from the command array, it will be the next argument after the symbol
-					int outFile = open(newFilePath,O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);//open the file for writing only
+/* struct substitution
+ * One "$(...)" on the line being expanded, and everything it has written so far
+ */
+struct substitution{
+	pid_t pid;//the subshell running the command, -1 if it couldn't be started
+	int fd;//read end of the pipe from the subshell's stdout, -1 once it has all been read
+	char *output;//the command's output, read straight into this buffer as it arrives
+	size_t length;//number of bytes in output
+	size_t capacity;//size of output, the buffer is kept for the next line
+};
 
-					if(outFile == -1){//if the file doesn't open, print an error and exit
-						printf("Error opening file \"%s\"\n",newFilePath);
-						fflush(stdout);
-						exit(1);
-					}
-					int result = dup2(outFile,1);//run dup2 to redirect the output to the new file
-					if(result == -1){//if there is a problem redirecting, print an error and exit
-						printf("Error redirecting output\n");
-						fflush(stdout);
-						exit(2);
-					}
-						
-					changedOut = true;//set changed out to true to prevent this from running again, even if there are duplicate symbols
-					numArguments -= 2;//decrease the number of aruments by 2, preventing the output redirection from passing to exec
-
-				}else if(strcmp(command[i],"<") == 0 && changedIn == false){//check if the input redirection symbol is found. changedIn make sure this only happens once
-					//redirect input
-					char *newFilePath = command[i+1];//get new file path from command array
-					int inFile = open(newFilePath,O_RDONLY, S_IRUSR | S_IWUSR);//open the input file for reasing only
-					
-					if(inFile == -1){//if the file doesn't open, print an error and exit
-						printf("Error opening file \"%s\"\n",newFilePath);
-						fflush(stdout);
-						exit(1);
-					}
+struct substitution *substitutions = NULL;//the substitutions in the command being expanded, in the order they appear
+int numSubstitutions = 0;
+int substitutionCapacity = 0;
 
-					int result = dup2(inFile, 0);//run dup2 to redirect the input to the new file
-					if(result == -1){//if there is a problem redirecting, print an error and exit
-						printf("Error redirecting input\n");
-						fflush(stdout);
-						exit(2);
-					}
-						
-					changedIn = true;//set changed in to true to prevent this from running again, even if there are duplicate symbols
-					numArguments -= 2;//decrease the number of arguments by 2, preventing the input redirection from passing to exec
-				}
-			}
+void runSubshell(char *text, size_t length);//runs in the forked child, it needs runNode, which comes after expandCommands
 
-			//Set signal handlers for this child process
-			struct sigaction ignore_action = {{0}};
-			ignore_action.sa_handler = SIG_IGN;//create ignore action
-			if(thisIsBackground && *numBackground >= MAX_BACKGROUND_PROCESSES){
-				printf("Error: too many background processes.\n");
-				fflush(stdout);
-				exit(0);
+/* substitutionEnd(char *)
+ * Takes the text just after a "$(" as input
+ * Returns the ")" that closes it, or NULL if it isn't closed. Nested "$(...)" are skipped over
+ */
+char *substitutionEnd(char *text){
+	int depth = 1;
+	for(; *text != '\0'; text++){
+		if(text[0] == '$' && text[1] == '('){
+			depth++;
+			text++;
+		}else if(*text == ')'){
+			depth--;
+			if(depth == 0){
+				return text;
 			}
-			if(thisIsBackground){//Check if this child is a background process, the signals need to be handled different if they are
-				sigaction(SIGTSTP,&ignore_action,NULL);//ignore SIGTSTP(Ctrl+z) and SIGINT(Ctrl+c) if in a background process
-				sigaction(SIGINT,&ignore_action,NULL);
-
-				//if the input and output haven't been redirected, redirect them to dev/null/
+		}
+	}
+	return NULL;
+}
 
-				if(changedIn == false){//if input wasn't redirected
-					int devNull = open("/dev/null",O_RDONLY);//open /dev/null for reading only
-					if(devNull == -1){//If there is an error opening /dev/null, print an error and exit
-						printf("Error opening file \"/dev/null\"\n");
-						fflush(stdout);
-						exit(1);
-					}
-					int result = dup2(devNull, 0);//redirect input to /dev/null
-					if(result == -1){//if there is an error redirecting input, print an error and exit
-						printf("Error redirecting input\n");
-						fflush(stdout);
-						exit(2);
-					}	
-				}
-				
-				if(changedOut == false){//if output wan't redirected
-					int devNull = open("/dev/null",O_WRONLY);//open /dev/null for writing only
-					if(devNull == -1){//If there is an error opening /dev/null, print an error and exit
-						printf("Error opening file \"/dev/null\"\n");
-						fflush(stdout);
-						exit(1);
-					}
-					int result = dup2(devNull, 1);//redirect output to /dev/null
-					if(result == -1){//If there is an error redirecting output, print an error and exit
-						printf("Errpr redirecting output\n");
-						fflush(stdout);
-						exit(2);
-					}
+/* startSubstitution(char *, size_t)
+ * Takes the command inside a "$(...)" and its length as inputs
+ * Returns nothing
+ * Forks a subshell to run the command with its stdout going into a pipe, and adds it to substitutions. The shell doesn't wait for it
+ * here, so every substitution on the line runs at the same time. If it can't be started its output is left empty
+ */
+void startSubstitution(char *text, size_t length){
+	if(numSubstitutions >= substitutionCapacity){
+		int newCapacity = substitutionCapacity == 0 ? 8 : substitutionCapacity * 2;
+		struct substitution *newSubstitutions = realloc(substitutions, newCapacity * sizeof(struct substitution));
+		if(newSubstitutions == NULL){//if there is no memory left, the shell can't keep going
+			printf("Error: out of memory\n");
+			fflush(stdout);
+			exit(1);
+		}
+		memset(newSubstitutions + substitutionCapacity, 0, (newCapacity - substitutionCapacity) * sizeof(struct substitution));
+		substitutions = newSubstitutions;
+		substitutionCapacity = newCapacity;
+	}
+	struct substitution *substitution = &substitutions[numSubstitutions];
+	numSubstitutions++;
+	substitution->pid = -1;
+	substitution->fd = -1;
+	substitution->length = 0;
 
-				}
+	int fds[2];
+	if(pipe2(fds, O_CLOEXEC) == -1){
+		printf("Error: unable to run \"%.*s\"\n",(int)length,text);
+		fflush(stdout);
+		return;
+	}
+	fflush(stdout);//anything still buffered would be written by both processes
+	pid_t pid = fork();
+	if(pid == 0){
+		close(fds[0]);
+		dup2(fds[1], 1);
+		close(fds[1]);
+		runSubshell(text, length);
+	}
+	close(fds[1]);
+	if(pid == -1){
+		close(fds[0]);
+		printf("Error: unable to run \"%.*s\"\n",(int)length,text);
+		fflush(stdout);
+		return;
+	}
+	substitution->pid = pid;
+	substitution->fd = fds[0];
+}
 
-			}else{
-				//if not in a background process
-				struct sigaction SIGINT_action = {{0}};//create SIGINT(Ctrl+c) struct
-
-				SIGINT_action.sa_handler = handle_SIGINT;//set the function to the handle_SIGINT function
-				sigfillset(&SIGINT_action.sa_mask);//fill the struct
-				SIGINT_action.sa_flags = 0;
-				sigaction(SIGINT,&SIGINT_action,NULL);
-
-				//Set ignore mask to prevent process fro exiting if (Ctrl+z) signal is recieved
-				//https://edstem.org/us/courses/6837/discussion/535386
-				sigset_t mask;
-				sigfillset(&mask);
-				sigdelset(&mask,SIGBUS);
-				sigdelset(&mask,SIGFPE);
-				sigdelset(&mask,SIGILL);
-				sigdelset(&mask,SIGSEGV);
-
-				ignore_action.sa_mask = mask;
-				sigaction(SIGTSTP,&ignore_action,NULL);//ignore SIGTSTP(Ctrl+z)
-			}
-			
-			char *execArgs[numArguments+1];//Create new array one longer than the number of arguments that can be passed to exec
-			for(int i = 0; i < numArguments; i++){
-				execArgs[i] = command[i];//fill the new array with all the arguments from the command array
+/* readSubstitutions(struct arena *)
+ * Takes an arena as input
+ * Returns nothing
+ * Reads the output of every substitution that was started, whichever has something ready first, until they have all closed
+ * their pipes. The line only waits as long as the slowest substitution. Trailing newlines are taken off each output
+ */
+void readSubstitutions(struct arena *arena){
+	struct pollfd *polls = arenaAlloc(arena, numSubstitutions * sizeof(struct pollfd));
+	int numOpen = 0;
+	for(int i = 0; i < numSubstitutions; i++){
+		polls[i].fd = substitutions[i].fd;//poll skips the -1s
+		polls[i].events = POLLIN;
+		if(substitutions[i].fd != -1){
+			numOpen++;
+		}
+	}
+	while(numOpen > 0){
+		if(poll(polls, numSubstitutions, -1) == -1){
+			if(errno == EINTR){//SIGCHLD as the subshells finish
+				continue;
 			}
-			if(numArguments > 0){//as long as there are more than 0 arguments
-				execArgs[numArguments] = NULL;//set the last spot in the array to null
-				execvp(execArgs[0],execArgs);//then pass it into execvp
-				//perror("exec()\n");//exec will only run anything past the function call if it failed, so print an error and exit
-				//fflush(stdout);
+			break;
+		}
+		for(int i = 0; i < numSubstitutions; i++){
+			if(polls[i].fd == -1 || polls[i].revents == 0){
+				continue;
 			}
-			exit(2);
-		}else{
-			//This is the parent process
-
-			if(thisIsBackground == false){//if the child process isn't a background process
-				spawnPid = waitpid(spawnPid, &childStatus, 0);//wait for the child to finish running
-				if(WIFEXITED(childStatus) == false){//If the child didn't exit properly
-					printf("terminated by signal %d\n",WTERMSIG(childStatus));//print termination signal
+			struct substitution *substitution = &substitutions[i];
+			if(substitution->capacity - substitution->length < 4096){
+				size_t newCapacity = substitution->capacity == 0 ? 65536 : substitution->capacity * 2;
+				char *newOutput = realloc(substitution->output, newCapacity);
+				if(newOutput == NULL){//if there is no memory left, the shell can't keep going
+					printf("Error: out of memory\n");
 					fflush(stdout);
-					recentStatus = WTERMSIG(childStatus);//set the status of the most recent command to the termination signal
-				}else{//if the child did exit properly
-					recentStatus = WEXITSTATUS(childStatus);//set the status of the most recent command to the exit status
+					exit(1);
 				}
-			}else{//if the child process is a background process
-				currentProcesses[*numBackground] = spawnPid;//adds the pid of the child to the array of background processes
-				*numBackground = *numBackground + 1;//increased the number of background processes by 1
+				substitution->output = newOutput;
+				substitution->capacity = newCapacity;
+			}
+			ssize_t numRead = read(substitution->fd, substitution->output + substitution->length, substitution->capacity - substitution->length);
+			if(numRead > 0){
+				substitution->length += numRead;
+			}else if(numRead == 0 || errno != EINTR){//the subshell and everything it started are done writing
+				close(substitution->fd);
+				substitution->fd = -1;
+				polls[i].fd = -1;
+				numOpen--;
 			}
-		
 		}
 	}
+	for(int i = 0; i < numSubstitutions; i++){
+		if(substitutions[i].fd != -1){//only left open if poll failed
+			close(substitutions[i].fd);
+			substitutions[i].fd = -1;
+		}
+		while(substitutions[i].length > 0 && substitutions[i].output[substitutions[i].length - 1] == '\n'){
+			substitutions[i].length--;
+		}
 	}
 }
-/* expandCommands(char [][], int)
- * takes an array of strings and an int as inputs
- * returns nothing
- * for each string in the array, replace any instance of "$$" with the process id
-*/
-void expandCommands(char command[MAX_NUM_ARGUMENTS][MAX_INPUT_LENGTH], int numArguments){
-	
 
-	if(DEBUG){
-		printf("Process ID is: %d\n",getpid());
-		fflush(stdout);
+/* expandCommands(char **[], int, struct arena *)
+ * takes a pointer to an array of strings, an int, and an arena as inputs
+ * returns the number of strings in the array after expansion
+ * for each string in the array, replaces "$$" with the shell's pid, "$?" with the most recent exit status, "$!" with the pid of the most recent
+ * background job, "$NAME" or "${NAME}" with the environment variable NAME (nothing if it isn't set), and "$(command)" with the output of
+ * the command. A "$" followed by anything else is left alone, and so is everything from an unclosed "${" or "$(" to the end of the word. A word that expands to nothing is dropped, and nothing an expansion
+ * produces is ever taken as an operator, since only the tokenizer's words are.
+ * Every "$(...)" in the command is started before anything is expanded, so they run at the same time. Their output is split into
+ * separate words wherever it has spaces, tabs or newlines, so when there are substitutions the array is replaced with a new one from the arena.
+ * Each word is expanded in one pass into a growable buffer and then copied into the arena, so the cost is linear in the length of the words.
+ * Words without a "$" are left where they are
+*/
+int expandCommands(char **command[], int numArguments, struct arena *arena){
+	char **words = *command;
+	numSubstitutions = 0;
+	for(int i = 0; i < numArguments; i++){//start every substitution first, skipping the other expansions the same way the loop below does
+		char *dollar = strchr(words[i], '$');
+		while(dollar != NULL){
+			char *next = dollar + 1;
+			char *end = NULL;
+			if(*next == '$' || *next == '?' || *next == '!'){
+				next++;
+			}else if(*next == '{'){
+				end = strchr(next, '}');
+				if(end == NULL){//the rest of the word is left as it is
+					break;
+				}
+				next = end + 1;
+			}else if(*next == '('){
+				end = substitutionEnd(next + 1);
+				if(end == NULL){
+					break;
+				}
+				startSubstitution(next + 1, end - next - 1);
+				next = end + 1;
+			}
+			dollar = strchr(next, '$');
+		}
 	}
-	char temp[500];
-	int pidLen = snprintf(temp, 500, "%d\n",getpid());
-	if(DEBUG){
-		printf("pidLen: %i\n",pidLen);
-		fflush(stdout);
+
+	char **expandedWords = words;//words are replaced in place unless a substitution could split them
+	if(numSubstitutions > 0){
+		readSubstitutions(arena);
+		int maxWords = numArguments;
+		for(int i = 0; i < numSubstitutions; i++){
+			maxWords += substitutions[i].length / 2 + 1;//the most words the output can split into
+		}
+		expandedWords = arenaAlloc(arena, (maxWords + 1) * sizeof(char *));
 	}
-	//string version of pid
-	char strpid[pidLen];
-	//store pid in strpid
-	sprintf(strpid, "%d", getpid());
 
-	char buffer[MAX_INPUT_LENGTH];//buffer for parts of word that come after $$
+	int numExpanded = 0;
+	int nextSubstitution = 0;
 	for(int i = 0; i < numArguments; i++){//repeat for all arguments in the command array
-		int pos = 0;//position in the command string
-		while(command[i][pos] != '\0'){//While the end of the coommand isn't reached
-			if(command[i][pos] == '$' && command[i][pos+1] == '$'){//if there are 2 '$' in a row
-				
-				int cpos = pos+2;//current position in the command string, after $$
-				int bpos = 0;//current position in the buffer string
-				while(command[i][cpos] != '\0'){//fill the buffer with the rest of the command string, starting at cpos
-					buffer[bpos] = command[i][cpos];
-					cpos++;
-					bpos++;
+		char *word = words[i];
+		char *dollar = strchr(word, '$');
+		if(dollar == NULL){//nothing to replace in this word
+			expandedWords[numExpanded] = word;
+			numExpanded++;
+			continue;
+		}
+
+		expansionLength = 0;
+		bool split = false;//true once a substitution's output is in the word, the word is split where the buffer has a null
+		char *copied = word;//everything before this has been added to the buffer
+		while(dollar != NULL){
+			appendExpansion(copied, dollar - copied);//the text before the $
+			char *next = dollar + 1;
+			char *end = NULL;
+			char number[24];
+			if(*next == '{'){
+				end = strchr(next, '}');
+			}else if(*next == '('){
+				end = substitutionEnd(next + 1);
+			}
+			if((*next == '{' || *next == '(') && end == NULL){//an unclosed ${ or $( leaves the rest of the word as it is, so nothing is scanned twice
+				copied = dollar;
+				break;
+			}
+			if(*next == '$'){//the shell's pid, made once at startup
+				appendExpansion(shellPid, shellPidLength);
+				next++;
+			}else if(*next == '?'){//the most recent exit status
+				appendExpansion(number, snprintf(number, sizeof(number), "%d", recentStatus));
+				next++;
+			}else if(*next == '!'){//the pid of the most recent background job, nothing if there hasn't been one
+				if(lastBackgroundPid != -1){
+					appendExpansion(number, snprintf(number, sizeof(number), "%d", lastBackgroundPid));
+				}
+				next++;
+			}else if(*next == '{'){//${NAME}
+				char *value = getVariable(next + 1, end - next - 1);
+				if(value != NULL){
+					appendExpansion(value, strlen(value));
+				}
+				next = end + 1;
+			}else if(*next == '('){//$(command), already run and read above
+				struct substitution *substitution = &substitutions[nextSubstitution];
+				nextSubstitution++;
+				size_t start = 0;//start of the output not added to the buffer yet
+				for(size_t j = 0; j < substitution->length; j++){
+					char c = substitution->output[j];
+					if(c == ' ' || c == '\t' || c == '\n' || c == '\0'){//whitespace splits the word, a null marks the spot
+						appendExpansion(substitution->output + start, j - start);
+						appendExpansion("", 1);
+						start = j + 1;
+					}
+				}
+				appendExpansion(substitution->output + start, substitution->length - start);
+				split = true;
+				next = end + 1;
+			}else if(*next == '_' || (*next >= 'A' && *next <= 'Z') || (*next >= 'a' && *next <= 'z')){//$NAME
+				char *nameEnd = next;
+				while(*nameEnd == '_' || (*nameEnd >= 'A' && *nameEnd <= 'Z') || (*nameEnd >= 'a' && *nameEnd <= 'z') || (*nameEnd >= '0' && *nameEnd <= '9')){
+					nameEnd++;
 				}
-				buffer[bpos] = '\0';//put a null terminator at the end of the buffer string
-				for(int j = 0; j < pidLen; j++){//starting at the first $, replace the letters in the command string with the pid
-					command[i][pos+j] = strpid[j];
+				char *value = getVariable(next, nameEnd - next);
+				if(value != NULL){
+					appendExpansion(value, strlen(value));
 				}
-				
-				bpos = 0;//reset buffer position to 0
-				cpos = pos+pidLen-1;//set command position to the end of the pid
-				while(buffer[bpos] != '\0'){//add the contents of the buffer to the end of the command string
-					command[i][cpos] = buffer[bpos];
-					bpos++;
-					cpos++;
+				next = nameEnd;
+			}else{//a $ that doesn't start an expansion stays as it is
+				appendExpansion("$", 1);
+			}
+			copied = next;
+			dollar = strchr(next, '$');
+		}
+		appendExpansion(copied, strlen(copied));//the text after the last $
+
+		if(split == false && expansionLength == 0){//a word that expanded to nothing, like an unset $NAME, isn't passed on as an empty argument
+			continue;
+		}
+		if(split == false){
+			char *expanded = arenaAlloc(arena, expansionLength + 1);
+			memcpy(expanded, expansionBuffer, expansionLength);
+			expanded[expansionLength] = '\0';//add a null terminator to the end of the expanded string
+			expandedWords[numExpanded] = expanded;
+			numExpanded++;
+			continue;
+		}
+		size_t start = 0;
+		for(size_t j = 0; j <= expansionLength; j++){//every piece between nulls is its own word, empty pieces are dropped
+			if(j == expansionLength || expansionBuffer[j] == '\0'){
+				if(j > start){
+					char *expanded = arenaAlloc(arena, j - start + 1);
+					memcpy(expanded, expansionBuffer + start, j - start);
+					expanded[j - start] = '\0';
+					expandedWords[numExpanded] = expanded;
+					numExpanded++;
 				}
-				command[i][cpos] = '\0';//add a null terminator to the end of the command string
+				start = j + 1;
+			}
+		}
+	}
+	expandedWords[numExpanded] = NULL;
+	*command = expandedWords;
+	return numExpanded;
+}
+
+/* enum nodeType
+ * The kinds of nodes in a parsed command line
+ */
+enum nodeType{
+	NODE_COMMAND,//one command, which can still be a pipeline or end with "&"
+	NODE_SEQUENCE,//"left ; right", right runs after left no matter what
+	NODE_AND,//"left && right", right only runs if left worked
+	NODE_OR//"left || right", right only runs if left failed
+};
+
+/* struct node
+ * One node of the tree a command line is parsed into. Every node comes from the command's arena
+ */
+struct node{
+	enum nodeType type;
+	struct node *left;//the part that runs first, for everything but commands
+	struct node *right;
+	char **command;//the command's words, for commands
+	int numArguments;
+};
+
+/* newNode(enum nodeType, struct node *, struct node *, struct arena *)
+ * Takes a node type, the left and right nodes, and the command's arena as inputs
+ * Returns the new node
+ */
+struct node *newNode(enum nodeType type, struct node *left, struct node *right, struct arena *arena){
+	struct node *node = arenaAlloc(arena, sizeof(struct node));
+	node->type = type;
+	node->left = left;
+	node->right = right;
+	node->command = NULL;
+	node->numArguments = 0;
+	return node;
+}
+
+/* parseCommandLine(char *[], int, struct arena *, char **)
+ * Takes the words of a line, the number of words, the command's arena, and a pointer to a string as inputs
+ * Returns the root of the parsed line, or NULL if it can't be parsed, with the string pointed at the word the problem is at
+ * Splits the words on ";", "&&" and "||" in one pass. "&&" and "||" bind tighter than ";" and both group left to right,
+ * so "a && b || c ; d" is ((a && b) || c) ; d. An "&" before more words ends its command the way ";" does but stays with it.
+ * Each operator is replaced by NULL, so the commands can be passed on in place
+ */
+struct node *parseCommandLine(char *words[], int numWords, struct arena *arena, char **errorWord){
+	struct node *list = NULL;//everything before the last ";"
+	struct node *andOr = NULL;//the && and || chain since the last ";"
+	enum nodeType pending = NODE_COMMAND;//the operator joining the next command onto andOr, NODE_COMMAND when there isn't one
+	int start = 0;//first word of the current command
+	for(int i = 0; i <= numWords; i++){
+		bool atEnd = i == numWords;
+		bool separator = atEnd == false && (strcmp(words[i], ";") == 0 || strcmp(words[i], "&&") == 0 || strcmp(words[i], "||") == 0);
+		bool background = atEnd == false && i + 1 < numWords && words[i] == backgroundOperator;
+		if(atEnd == false && separator == false && background == false){
+			continue;
+		}
+
+		int end = background ? i + 1 : i;//the "&" stays in the command so handleCommand sees it
+		if(end == start){//nothing between two operators
+			if(atEnd && pending == NODE_COMMAND && andOr == NULL && list != NULL){//a ";" at the end of the line is fine
+				break;
+			}
+			*errorWord = atEnd ? "newline" : words[i];
+			return NULL;
+		}
+		struct node *command = newNode(NODE_COMMAND, NULL, NULL, arena);
+		command->command = &words[start];
+		command->numArguments = end - start;
+
+		andOr = pending == NODE_COMMAND ? command : newNode(pending, andOr, command, arena);
+		if(atEnd || background || strcmp(words[i], ";") == 0){//the chain is finished, add it to the list
+			list = list == NULL ? andOr : newNode(NODE_SEQUENCE, list, andOr, arena);
+			andOr = NULL;
+			pending = NODE_COMMAND;
+		}else{
+			pending = strcmp(words[i], "&&") == 0 ? NODE_AND : NODE_OR;
+		}
+		if(separator){
+			words[i] = NULL;//end the command before it
+		}
+		start = i + 1;
+	}
+	return list;
+}
+
+/* runNode(struct node *, bool *, struct jobTable *, struct arena *)
+ * Takes a parsed line, a pointer to a bool, the job table, and the command's arena as inputs
+ * Returns nothing
+ * Runs the line in order. Each command is expanded right before it runs, so $? sees the command before it in the same line,
+ * and recentStatus decides whether the right side of && and || runs. Nothing else runs once exit is used
+ */
+void runNode(struct node *node, bool *repeat, struct jobTable *jobTable, struct arena *arena){
+	if(node->type == NODE_COMMAND){
+		node->numArguments = expandCommands(&node->command, node->numArguments, arena);//Expand $$, $?, $!, environment variables and $(command)
+		traceEvent(TRACE_EXPAND, tracePid, 0, NULL);
+		if(node->numArguments == 0){//every word in the command expanded to nothing
+			return;
+		}
+		if(DEBUG){
+			printf("Expanded arguments: \n");
+			for(int i = 0; i < node->numArguments; i++){
+				printf("%s\n",node->command[i]);
 			}
-		pos++;//increase the position in the command string by 1
+			fflush(stdout);
+		}
+		handleCommand(node->command, node->numArguments, repeat, jobTable, arena);
+		return;
+	}
+	runNode(node->left, repeat, jobTable, arena);
+	if(*repeat == false){
+		return;
+	}
+	if(node->type == NODE_SEQUENCE || (node->type == NODE_AND && recentStatus == 0) || (node->type == NODE_OR && recentStatus != 0)){
+		runNode(node->right, repeat, jobTable, arena);
+	}
+}
+/* runSubshell(char *, size_t)
+ * Takes the command inside a "$(...)" and its length as inputs
+ * Never returns
+ * Runs in the child forked for a command substitution, with stdout already going into the pipe. The command is parsed and run the
+ * same way a line typed at the prompt is, so ;, &&, || and nested substitutions all work, then the child exits with its status
+ */
+void runSubshell(char *text, size_t length){
+	for(int i = 0; i < numSubstitutions; i++){//the read ends of the other substitutions belong to the parent shell
+		if(substitutions[i].fd != -1){
+			close(substitutions[i].fd);
+		}
+	}
+	numSubstitutions = 0;
+	interactive = false;
+	jobControl = false;//the subshell's commands stay in the process group of the job it is part of
+	if(zygoteFd != -1){//the zygote answers one request at a time, so only the parent shell talks to it
+		close(zygoteFd);
+		zygoteFd = -1;
+		launchBackend = LAUNCH_SPAWN;
+	}
+	traceCount = 0;//records from before the fork are the parent's to write
+	tracePid = getpid();//$$ stays the parent's pid, but the trace should show which process did the work
+	reapHead = 0;//and so are the children it had reaped
+	reapTail = 0;
+
+	struct arena arena = {0};
+	struct jobTable jobTable = {.freeHead = -1};
+	char *line = arenaAlloc(&arena, length + 1);
+	memcpy(line, text, length);
+	line[length] = '\0';
+	char **words;
+	int numWords = convertToWords(line, length, &arena, &words);
+	if(numWords > 0){
+		char *errorWord;
+		struct node *commandLine = parseCommandLine(words, numWords, &arena, &errorWord);
+		if(commandLine == NULL){
+			printf("Error: syntax error near \"%s\"\n",errorWord);
+			recentStatus = 1;
+		}else{
+			bool repeat = true;
+			runNode(commandLine, &repeat, &jobTable, &arena);
 		}
 	}
+	flushTrace();
+	fflush(stdout);
+	_exit(recentStatus);
+}
+
+
+/* initJobControl()
+ * Takes no inputs
+ * Returns nothing
+ * Turns on job control when the shell is reading from a terminal. The shell waits until it is in the foreground, moves into its
+ * own process group, and takes the terminal. From then on each job gets its own process group and is handed the terminal while it
+ * runs in the foreground, so ^C and ^Z go to the whole job and never to the shell
+ */
+void initJobControl(){
+	shellGroup = getpgrp();
+	pid_t owner = tcgetpgrp(0);
+	while(owner != -1 && owner != shellGroup){//started in the background, stop until the terminal is handed over
+		kill(-shellGroup, SIGTTIN);
+		shellGroup = getpgrp();
+		owner = tcgetpgrp(0);
+	}
+	if(owner == -1){//not a controlling terminal, so there is nothing to hand out
+		return;
+	}
+	struct sigaction ignore_action = {{0}};
+	ignore_action.sa_handler = SIG_IGN;
+	sigaction(SIGTTIN, &ignore_action, NULL);//the shell reads and changes the terminal while it isn't the foreground group
+	sigaction(SIGTTOU, &ignore_action, NULL);
+	setpgid(0, 0);//fails for a session leader, which already has its own group
+	shellGroup = getpgrp();
+	terminalFd = fcntl(0, F_DUPFD_CLOEXEC, 10);
+	if(terminalFd == -1 || tcsetpgrp(terminalFd, shellGroup) == -1){
+		return;
+	}
+	tcgetattr(terminalFd, &shellModes);
+	jobControl = true;
 }
 
 int main(int argc, char *argv[]){
@@ -444,12 +4439,69 @@ int main(int argc, char *argv[]){
 	SIGTSTP_action.sa_flags = 0;
 	sigaction(SIGTSTP,&SIGTSTP_action,NULL);
 
+	struct sigaction SIGCHLD_action = {{0}};//reap children as soon as they finish
+	SIGCHLD_action.sa_handler = handle_SIGCHLD;
+	sigfillset(&SIGCHLD_action.sa_mask);
+	SIGCHLD_action.sa_flags = SA_RESTART;//SA_RESTART so reading the next command isn't interrupted, and stopped children are reported too
+	sigaction(SIGCHLD,&SIGCHLD_action,NULL);
+
+	tracePid = getpid();
+	shellPidLength = snprintf(shellPid, sizeof(shellPid), "%d", tracePid);//make the string for $$ once
+	initEnvironment();//before the zygote starts, so it begins with the same environment
+
+	struct inputReader reader;//where commands come from, a script if one was given, otherwise stdin
+	if(argc > 2){
+		printf("Usage: %s [script]\n",argv[0]);
+		fflush(stdout);
+		return 1;
+	}else if(argc == 2){//run the commands in the script instead of prompting
+		int scriptFile = open(argv[1], O_RDONLY | O_CLOEXEC);
+		if(scriptFile == -1){
+			printf("Error opening file \"%s\"\n",argv[1]);
+			fflush(stdout);
+			return 1;
+		}
+		openReader(&reader, scriptFile);
+		commandFd = scriptFile;
+	}else{
+		openReader(&reader, 0);
+		commandFd = 0;
+		interactive = isatty(0);//piped or redirected input runs as a batch, without prompts
+		if(interactive){
+			initJobControl();//before the zygote starts, so it shares the shell's process group
+		}
+	}
+
+	char *launchSetting = getenv("SMALLSH_LAUNCH");//pick the launch backend, posix_spawn unless fork or zygote is asked for
+	if(launchSetting != NULL && strcmp(launchSetting, "fork") == 0){
+		launchBackend = LAUNCH_FORK;
+	}else if(launchSetting != NULL && strcmp(launchSetting, "zygote") == 0){
+		launchBackend = LAUNCH_ZYGOTE;
+		startZygote();//as early as possible, so the zygote copies as little of the shell as it can
+	}
+
+	char *traceSetting = getenv("SMALLSH_TRACE");//file or fd number to write the trace log to
+	if(traceSetting != NULL && startTrace(traceSetting) == false){
+		printf("Error opening trace log \"%s\"\n",traceSetting);
+		fflush(stdout);
+	}
+
+	if(interactive){//scripts and batches neither record nor expand history, so they don't pay to map it
+		loadHistory();
+	}
+
+	char *pipeSetting = getenv("SMALLSH_PIPESZ");//bytes to grow each pipe in a pipeline to, for stages moving a lot of data
+	if(pipeSetting != NULL){
+		pipeBufferSize = atoi(pipeSetting);
+	}
+
 	bool repeat = true;//Code will continue to prompt user for inputs while repeat is true
-	int currentProcesses[MAX_BACKGROUND_PROCESSES];//array to store the pids of each background processes running
-	int numBackground = 0;//the current number of background processes running
+	char *userInput;//the line being run, it points into the reader's buffer
+	struct arena commandArena = {0};//holds the argument array and expanded words for the current command
+	struct jobTable jobTable = {.freeHead = -1};//every process the shell has started and is still waiting on
 
 	while(repeat){
-		//Before user input is prompted, print out changed to foreground mode and clear any zombie processes
+		//Before user input is prompted, print out changed to foreground mode and report finished background processes
 		if(modeChanged == true){//If the foreground only mode has been changed since the last time the user was prompted, print out the new mode
 			modeChanged = false;
 			if(foregroundOnly){
@@ -461,39 +4513,39 @@ int main(int argc, char *argv[]){
 			}
 		}
 
-		//loop through the background processes and wait for each one using WNOHANG
-		for(int i = 0; i < numBackground; i++){
-			int childStatus;
-			pid_t childPid = currentProcesses[i];//get process pid from array
-			childPid = waitpid(childPid, &childStatus, WNOHANG);//wait for process, immediatly returning 0 if the process is still running
-
-			if(childPid != 0){//if the process isn't still running
-				currentProcesses[i] = -1;//set the pid to -1 in the process array
-				printf("background pid %i is done: exit value %i\n",childPid, WEXITSTATUS(childStatus));
-				fflush(stdout);
-			}
+		//report any background processes the SIGCHLD handler has reaped
+		if(reapHead != reapTail){//only pay for blocking SIGCHLD when something is waiting, a child reaped after this is picked up next time
+			sigset_t childMask, oldMask;
+			sigemptyset(&childMask);
+			sigaddset(&childMask, SIGCHLD);
+			sigprocmask(SIG_BLOCK, &childMask, &oldMask);
+			collectChildren(&jobTable);
+			sigprocmask(SIG_SETMASK, &oldMask, NULL);
 		}
 
-		for(int i = 0; i < numBackground; i++){//loop through the array again
-			if(currentProcesses[i] == -1){//if the pid of the process was set to -1
-				for(int x = i+1; x < numBackground; x++){//move all the other pids after this one back one spot in the array, replacing the -1 spot
-					currentProcesses[x-1] = currentProcesses[x];
-				}
-				numBackground -= 1;//decrease the number of background processes by 1
-			}
+		if(interactive && traceCount > 0){//write the trace out while the shell is waiting on the user anyway
+			flushTrace();
 		}
-
-		char userInput[MAX_INPUT_LENGTH];//create array to read user input
-		int numChars = promptUser(": ", userInput);//runs prompt user function and stores the number of characters in numChars
-
-		if(isBlankOrComment(userInput, numChars)){//If the command is just a blank line or a comment line, do nothing
+		int numChars = promptUser(": ", &reader, &userInput);//runs prompt user function and stores the number of characters in numChars
+		if(numChars == -1){//If there is no more input, exit the same way the exit command does
+			char *exitCommand[] = {"exit", NULL};
+			handleCommand(exitCommand, 1, &repeat, &jobTable, &commandArena);
+		}else if(isBlankOrComment(userInput, numChars)){//If the command is just a blank line or a comment line, do nothing
 			if(DEBUG){
 				printf("Blank line or comment! No commands...\n");
 				fflush(stdout);
 			}
+		}else if(interactive && userInput[0] == '!' && numChars > 1 && expandHistory(&userInput, &numChars, &commandArena) == false){//!prefix with nothing in the history to run
+			printf("Error: no command in history starting with \"%s\"\n",userInput + 1);
+			fflush(stdout);
+			recentStatus = 1;
+			recentLimits[0] = '\0';
 		}else{
-			char arguments[MAX_NUM_ARGUMENTS][MAX_INPUT_LENGTH];//create an array for the seperate arguments in the command
-			int numArguments = convertToWords(userInput, numChars, arguments);//convert the input to seperate arguments and store the number of arguments in numArguments
+			recordHistory(userInput, numChars);//save the line before it gets split into words
+			char **arguments;//array for the seperate arguments in the command, it points into userInput
+			traceEvent(TRACE_PARSE_START, tracePid, 0, NULL);
+			int numArguments = convertToWords(userInput, numChars, &commandArena, &arguments);//convert the input to seperate arguments and store the number of arguments in numArguments
+			traceEvent(TRACE_PARSE_END, tracePid, numArguments, NULL);
 			if(DEBUG){
 				printf("Arguments found: \n");
 				for(int i = 0; i < numArguments; i++){
@@ -501,19 +4553,22 @@ int main(int argc, char *argv[]){
 				}
 				fflush(stdout);	
 			}
-			expandCommands(arguments, numArguments);//Expand any instance of $$ into the process id of the shell
-			if(DEBUG){
-				printf("Expanded arguments: \n");
-				for(int i = 0; i < numArguments; i++){
-					printf("%s\n",arguments[i]);
-				}
+			char *errorWord;
+			struct node *commandLine = parseCommandLine(arguments, numArguments, &commandArena, &errorWord);//split the line on ;, && and ||
+			if(commandLine == NULL){
+				printf("Error: syntax error near \"%s\"\n",errorWord);
 				fflush(stdout);
+				recentStatus = 1;
+				recentLimits[0] = '\0';
+			}else{
+				runNode(commandLine, &repeat, &jobTable, &commandArena);//run each command in the line, expanding it just before it runs
 			}
-			handleCommand(arguments, numArguments, &repeat, currentProcesses, &numBackground);//pass the command array into the handleCommand function
+			arenaReset(&commandArena);//everything allocated for this command can be reused by the next one
 		}
 
 
 	}
 
+	stopTrace();
 	return 0;
 }